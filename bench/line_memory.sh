@@ -0,0 +1,32 @@
+#!/bin/sh
+#   Author: Dishank Goel
+#   Date written: 21st August 2020
+#
+#   line_memory.sh checks that the memory of the shell does not grow with the number of lines it runs
+#   the lines are parsed into an arena which is reset for every line, so the peak RSS after
+#   a million lines has to be the same as after a thousand
+#   every line is run inside the shell (cd and the builtin cat), so no process is started
+#   the shell prints its own peak RSS at the end, by running the builtin cat on /proc/self/status
+#   Usage: bench/line_memory.sh [SHELL] [LINES]
+
+SHELL_PATH=${1:-./shell}
+LINES=${2:-1000000}
+SLACK_KB=256        # allowed growth, for the pages touched by stdio and the allocator
+LINE="cd . ; cd '.' && cd \"./\" || cd . # quoted words, lists and a comment"
+
+peak_rss() {
+    { yes "$LINE" | head -n "$1"; echo "cat /proc/self/status"; } |
+        "$SHELL_PATH" | awk '/^VmHWM:/ { print $2 }'
+}
+
+small=$(peak_rss 1000)
+large=$(peak_rss "$LINES")
+if [ -z "$small" ] || [ -z "$large" ]; then
+    echo "line_memory: cannot read the peak RSS of $SHELL_PATH" >&2
+    exit 1
+fi
+echo "peak RSS after 1000 lines: $small kB, after $LINES lines: $large kB"
+if [ "$large" -gt $((small + SLACK_KB)) ]; then
+    echo "line_memory: the memory grows with the number of lines" >&2
+    exit 1
+fi
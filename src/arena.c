@@ -0,0 +1,70 @@
+/*  Author: Dishank Goel
+*   Date written: 21st August 2020
+*
+*   Arena allocator, read more in arena.h
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+/*  arena_alloc - size bytes aligned to align (a power of 2), returns NULL if there is no memory
+*/
+void *arena_alloc(struct arena *arena, size_t size, size_t align) {
+    struct arena_chunk *chunk = arena->head;
+    size_t start = (chunk == NULL) ? 0 : (chunk->used + align - 1) & ~(align - 1);
+    if(chunk == NULL || start + size > chunk->size) {
+        size_t chunk_size = (size > arena->chunk_size) ? size : arena->chunk_size;
+        chunk = malloc(sizeof(struct arena_chunk) + chunk_size);
+        if(chunk == NULL) {
+            return NULL;
+        }
+        chunk->next = arena->head;
+        chunk->used = 0;
+        chunk->size = chunk_size;
+        arena->head = chunk;
+        start = 0;
+    }
+    chunk->used = start + size;
+    return chunk->data + start;
+}
+
+/*  arena_copy - a copy of the string of length bytes, ended by '\0'
+*/
+char *arena_copy(struct arena *arena, const char *string, size_t length) {
+    char *copy = arena_alloc(arena, length + 1, 1);
+    if(copy != NULL) {
+        memcpy(copy, string, length);
+        copy[length] = '\0';
+    }
+    return copy;
+}
+
+/*  arena_reset - frees everything allocated, but keeps one chunk to be used again
+*   so an arena reset in a loop does not call malloc, unless a round needs more than a chunk
+*/
+void arena_reset(struct arena *arena) {
+    struct arena_chunk *keep = NULL;
+    while(arena->head != NULL) {
+        struct arena_chunk *next = arena->head->next;
+        if(keep == NULL && arena->head->size == arena->chunk_size) {
+            keep = arena->head;
+        } else {
+            free(arena->head);
+        }
+        arena->head = next;
+    }
+    if(keep != NULL) {
+        keep->next = NULL;
+        keep->used = 0;
+    }
+    arena->head = keep;
+}
+
+void arena_free(struct arena *arena) {
+    while(arena->head != NULL) {
+        struct arena_chunk *next = arena->head->next;
+        free(arena->head);
+        arena->head = next;
+    }
+}
@@ -0,0 +1,34 @@
+/*  Author: Dishank Goel
+*   Date written: 21st August 2020
+*
+*   Arena allocator, for many small allocations which are all freed together
+*   like the names of a directory in ls, or the words of a command line in the shell
+*   Memory is handed out of big chunks one after the other. Chunks are never moved, so pointers
+*   into them stay valid until the arena is reset or freed
+*/
+
+#ifndef NEOSH_ARENA_H
+#define NEOSH_ARENA_H
+
+#include <stddef.h>
+
+struct arena_chunk {
+    struct arena_chunk *next;
+    size_t used;
+    size_t size;
+    char data[];
+};
+
+struct arena {
+    struct arena_chunk *head;
+    size_t chunk_size;          // an allocation bigger than this gets a chunk of its own
+};
+
+#define ARENA_INIT(chunk_size) {NULL, (chunk_size)}
+
+void *arena_alloc(struct arena *arena, size_t size, size_t align);
+char *arena_copy(struct arena *arena, const char *string, size_t length);
+void arena_reset(struct arena *arena);
+void arena_free(struct arena *arena);
+
+#endif
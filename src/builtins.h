@@ -0,0 +1,23 @@
+/*  Author: Dishank Goel
+*   Date written: 21st August 2020
+*
+*   Entry points of the self implemented commands
+*   Every src/<command>.c defines <command>_main, which is called by its own main() in bin/<command>
+*   and directly by the shell, when the file is compiled with NEOSH_BUILTIN and linked into it
+*   The entry points return the exit status instead of calling exit(), so that the shell survives them
+*/
+
+#ifndef NEOSH_BUILTINS_H
+#define NEOSH_BUILTINS_H
+
+int cat_main(int argc, char *argv[]);
+int chmod_main(int argc, char *argv[]);
+int cp_main(int argc, char *argv[]);
+int grep_main(int argc, char *argv[]);
+int ls_main(int argc, char *argv[]);
+int mkdir_main(int argc, char *argv[]);
+int mv_main(int argc, char *argv[]);
+int pwd_main(int argc, char *argv[]);
+int rm_main(int argc, char *argv[]);
+
+#endif
@@ -7,46 +7,147 @@
 *   Usage: ./cat [FILE]...
 */
 
+#define _GNU_SOURCE     // Declared for splice
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/sendfile.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <errno.h>
 #include <string.h>
 #include "util.h"
+#include "outbuf.h"
+#include "builtins.h"
 
-/*  print_file - takes the file name and prints all it's content
-*   handles errors when file is not accessible, or is a directory 
+#define SEND_SIZE (1 << 30)         // bytes asked from splice or sendfile in one call
+#define SMALL_FILE_SIZE (1 << 16)   // files smaller than this are read into the output buffer
+
+static struct outbuf out;           // small files are gathered here and written together
+
+/*  send_file - moves the whole file to stdout inside the kernel, without copying it through cat
+*   splice is used when the file or stdout is a pipe (like cat being a stage of a pipeline),
+*   sendfile when stdout is a regular file or anything else that accepts it
+*   returns 1 if neither can be used, so that the file is copied through a buffer
 */
-int print_file(char *file) {
-    FILE *fp = fopen(file, "r");
-    if (fp == NULL) {
-        fprintf(stderr, "cat: cannot open '%s': %s\n", file, strerror(errno));
-        exit(EXIT_FAILURE);     // exit as soon as file cannot be opened, mentioned in wcat
-    } else {
-        if(check_dir(file)) {       // check_dir is in util.h
-            fprintf(stderr, "cat: cannot read '%s': Is a directory\n", file);
+static int send_file(int fd, struct stat *file_stat) {
+    struct stat out_stat;
+    int use_splice = S_ISFIFO(file_stat->st_mode) ||
+                     (fstat(STDOUT_FILENO, &out_stat) == 0 && S_ISFIFO(out_stat.st_mode));
+    ssize_t n = 0;
+    int moved = 0;
+    if(outbuf_flush(&out) == -1) {      // the small files before it come first
+        fprintf(stderr, "cat: write error: %s\n", strerror(out.error));
+        return -1;
+    }
+    while(!command_interrupted) {
+        if(use_splice) {
+            n = splice(fd, NULL, STDOUT_FILENO, NULL, SEND_SIZE, SPLICE_F_MOVE | SPLICE_F_MORE);
         } else {
-            char *buffer;
-            buffer = malloc(4096*sizeof(char));
-            while (fgets(buffer, 4096, fp) != NULL) {
-                printf("%s", buffer);
-
-                /*  If the file does not end in newline,
-                *   the buffer is not flushed and the order of printing maybe wrong with multiple arguments */
-                fflush(stdout);  
+            n = sendfile(STDOUT_FILENO, fd, NULL, SEND_SIZE);
+        }
+        if(n <= 0) {
+            break;
+        }
+        moved = 1;
+    }
+    if(n == -1) {
+        if(!moved && (errno == EINVAL || errno == ENOSYS)) {     // these files do not support it
+            return 1;
+        }
+        fprintf(stderr, "cat: write error: %s\n", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/*  copy_file - reads the file straight into the output buffer, which is written when it is full
+*   the contents of small files are written together with the files after them
+*/
+static int copy_file(int fd) {
+    ssize_t nread;
+    while(!command_interrupted) {
+        size_t available;
+        char *space = outbuf_space(&out, &available);
+        if(space == NULL) {
+            fprintf(stderr, "cat: write error: %s\n", strerror(out.error));
+            return -1;
+        }
+        nread = read(fd, space, available);
+        if(nread == 0) {
+            break;
+        } else if(nread == -1) {
+            if(errno == EINTR) {
+                continue;
             }
-            free(buffer);
+            outbuf_flush(&out);
+            fprintf(stderr, "cat: read error: %s\n", strerror(errno));
+            return -1;
         }
+        outbuf_commit(&out, nread);
     }
-    fclose(fp);
     return 0;
 }
 
-int main(int argc, char *argv[]) {
+/*  print_file - takes the file name and prints all it's content
+*   handles errors when file is not accessible, or is a directory 
+*   the file is written straight to the fd of stdout, without stdio
+*   small regular files (and /proc files, which have no size) are read into the output buffer,
+*   bigger files are sent by the kernel
+*   returns -1 if the file cannot be opened, 1 if it could not be printed whole, 0 otherwise
+*/
+static int print_file(char *file) {
+    int fd = open(file, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        int error = errno;
+        outbuf_flush(&out);
+        fprintf(stderr, "cat: cannot open '%s': %s\n", file, strerror(error));
+        return -1;     // stop as soon as file cannot be opened, mentioned in wcat
+    }
+    struct stat statbuf;
+    int result;
+    if(fstat(fd, &statbuf) == -1) {        // the kind and size are unknown, the plain read loop needs neither
+        result = copy_file(fd);
+    } else if(S_ISDIR(statbuf.st_mode)) {
+        outbuf_flush(&out);
+        fprintf(stderr, "cat: cannot read '%s': Is a directory\n", file);
+        result = -1;
+    } else if(S_ISREG(statbuf.st_mode) && statbuf.st_size < SMALL_FILE_SIZE) {
+        result = copy_file(fd);
+    } else if((result = send_file(fd, &statbuf)) == 1) {
+        result = copy_file(fd);
+    }
+    close(fd);
+    return result == 0 ? 0 : 1;
+}
 
-    for(int i = 1; i < argc; i++) {
-        print_file(argv[i]);
+int cat_main(int argc, char *argv[]) {
+
+    if(outbuf_init(&out, STDOUT_FILENO) == -1) {    // anything printed before with stdio comes first
+        fprintf(stderr, "cat: %s\n", strerror(ENOMEM));
+        return EXIT_FAILURE;
     }
-    exit(EXIT_SUCCESS);
-}
\ No newline at end of file
+    int status = EXIT_SUCCESS;
+    for(int i = 1; i < argc && !command_interrupted; i++) {
+        int result = print_file(argv[i]);
+        if(result != 0) {
+            status = EXIT_FAILURE;
+        }
+        if(result == -1) {
+            break;
+        }
+    }
+    if(outbuf_flush(&out) == -1) {
+        fprintf(stderr, "cat: write error: %s\n", strerror(out.error));
+        status = EXIT_FAILURE;
+    }
+    outbuf_free(&out);
+    return command_interrupted ? INTERRUPTED_STATUS : status;
+}
+
+#ifndef NEOSH_BUILTIN
+int main(int argc, char *argv[]) {
+    return cat_main(argc, argv);
+}
+#endif
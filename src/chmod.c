@@ -1,64 +1,419 @@
 /*  Author: Dishank Goel
 *   Date written: 21st August 2020
-*   
-*   chmod.c implements the `chmod` command in UNIX without any options
+*
+*   chmod.c implements the `chmod` command in UNIX with -R option
 *   chmod is used to change permissions of a file
-*   Usage: chmod MODE FILE...
+*   the mode is octal (like 755) or symbolic (like u+x,go-w), it is compiled once for all the files
+*   -R changes the files inside the directories too, the tree is walked by a pool of workers
+*   Usage: chmod [-R] MODE FILE...
 */
 
+#define _GNU_SOURCE     // Declared for O_DIRECTORY and O_NOFOLLOW
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
 #include <errno.h>
 #include <string.h>
 #include <sys/stat.h>
-#define MAX_SHELL_PATH 1024
+#include "util.h"
+#include "pool.h"
+#include "builtins.h"
 
-int print_usage() {
-    printf("Usage: chmod MODE FILE...\n");
+#define EXEC_BITS (S_IXUSR | S_IXGRP | S_IXOTH)
+
+/*  mode_change - the mode given to chmod, compiled once and applied to every file as
+*   new mode = (old mode & and_mask) | or_mask
+*   X gives execute permission only to directories and files which have some already,
+*   so they get their own pair of masks, x_and_mask and x_or_mask
+*   directories keep their setuid and setgid bits unless the mode has s for them, like in UNIX chmod
+*   X after another operation looks at the mode made by the operations before it, like u=rwx,g+X
+*   giving g+x, so for files the operations are then applied one by one (they are kept in ops)
+*/
+struct mode_op {
+    mode_t and_mask, or_mask;
+    mode_t x_and_mask, x_or_mask;
+};
+
+struct mode_change {
+    mode_t and_mask, or_mask;
+    mode_t x_and_mask, x_or_mask;
+    mode_t dir_keep;        // bits of directories which are never changed
+    int needs_old;          // the new mode depends on the old one, so every file has to be statted
+    struct mode_op *ops;
+    int num_ops;
+    int stepwise;           // X comes after another operation, files need the ops one by one
+};
+
+static struct mode_change change;
+static int recursive;           // -R
+static atomic_int any_error;
+
+static int print_usage() {
+    printf("Usage: chmod [-R] MODE FILE...\n");
     printf("chmod is a utility to change the permission of a file\n");
     return 0;
 }
 
-/* change_permission - takes the decimal mode and file path to change its permissions
+/*  apply_op - composes one operation of a symbolic mode with the masks compiled so far
+*   bits are the permissions given to the operation, affected are the ones it may change
+*/
+static void apply_op(mode_t *and_mask, mode_t *or_mask, char op, mode_t bits, mode_t affected) {
+    if(op == '+') {
+        *or_mask |= bits;
+    } else if(op == '-') {
+        *and_mask &= ~bits;
+        *or_mask &= ~bits;
+    } else {        // '=', everything it may change is cleared first
+        *and_mask &= ~affected;
+        *or_mask = (*or_mask & ~affected) | bits;
+    }
+}
+
+/*  compile_mode - parses the octal or symbolic mode into the masks of a mode_change
+*   a symbolic mode is a list of clauses like u+x,go-w,a=rX, and every clause is a change of
+*   the masks, so the whole list becomes a single pair. Without u, g, o or a, the clause works
+*   on all of them except the bits of the umask, like in UNIX chmod
+*   returns -1 if the mode is invalid
 */
-int change_permission(char *file, char *mode) {
-    int i;
-    i = strtol(mode, NULL, 8);      // covert the decimal mode to octal
-    /*  1st condition: if return value of strtol is 0 and mode itself is not 0
-    *   2nd condition: the mode is not negative
-    *   3rd condition: the mode is not greater than octal(7777) = 4095
-    */
-    if((i == 0 && atoi(mode) != 0) || (i < 0) || (i > 4095) ) {   
-        fprintf(stderr, "chmod: invalid mode: '%s'\n", mode);
-        exit(EXIT_FAILURE);
-    }
-    if(chmod(file, i) < 0) {
-        fprintf(stderr, "chmod: %s\n", strerror(errno));
+static int compile_mode(char *text, struct mode_change *c) {
+    if(text[0] >= '0' && text[0] <= '7') {
+        char *end;
+        long value = strtol(text, &end, 8);
+        if(*end != '\0' || value > 07777) {
+            return -1;
+        }
+        c->and_mask = c->x_and_mask = 0;
+        c->or_mask = c->x_or_mask = value;
+        c->dir_keep = S_ISUID | S_ISGID;
+        c->needs_old = 0;
+        c->stepwise = 0;
+        return 0;
+    }
+
+    mode_t mask = umask(0);
+    umask(mask);
+    c->and_mask = c->x_and_mask = 07777;
+    c->or_mask = c->x_or_mask = 0;
+    c->dir_keep = S_ISUID | S_ISGID;
+    c->num_ops = c->stepwise = 0;
+    c->ops = malloc(strlen(text) * sizeof(struct mode_op));     // every operation takes at least one character
+    if(c->ops == NULL) {
         return -1;
     }
+    char *p = text;
+    while(1) {
+        mode_t who = 0;
+        for(; *p != '\0' && strchr("ugoa", *p) != NULL; p++) {
+            who |= (*p == 'u') ? (S_ISUID | S_IRWXU) : (*p == 'g') ? (S_ISGID | S_IRWXG) :
+                   (*p == 'o') ? (S_ISVTX | S_IRWXO) : 07777;
+        }
+        mode_t affected = who ? who : (07777 & ~mask);
+        if(*p != '+' && *p != '-' && *p != '=') {
+            return -1;
+        }
+        while(*p == '+' || *p == '-' || *p == '=') {
+            char op = *p++;
+            mode_t bits = 0, x_bits = 0;
+            for(; *p != '\0' && strchr("rwxXst", *p) != NULL; p++) {
+                switch(*p) {
+                case 'r': bits |= S_IRUSR | S_IRGRP | S_IROTH; break;
+                case 'w': bits |= S_IWUSR | S_IWGRP | S_IWOTH; break;
+                case 'x': bits |= EXEC_BITS; break;
+                case 'X': x_bits |= EXEC_BITS; break;
+                case 's': bits |= S_ISUID | S_ISGID; c->dir_keep &= ~affected; break;
+                case 't': bits |= S_ISVTX; break;
+                }
+            }
+            c->stepwise |= (x_bits != 0 && c->num_ops > 0);
+            x_bits |= bits;
+            apply_op(&c->and_mask, &c->or_mask, op, bits & affected, affected);
+            apply_op(&c->x_and_mask, &c->x_or_mask, op, x_bits & affected, affected);
+            struct mode_op *o = &c->ops[c->num_ops++];
+            o->and_mask = o->x_and_mask = 07777;
+            o->or_mask = o->x_or_mask = 0;
+            apply_op(&o->and_mask, &o->or_mask, op, bits & affected, affected);
+            apply_op(&o->x_and_mask, &o->x_or_mask, op, x_bits & affected, affected);
+        }
+        if(*p == '\0') {
+            break;
+        } else if(*p != ',') {
+            return -1;
+        }
+        p++;
+    }
+    c->needs_old = c->and_mask != 0 || c->x_and_mask != 0 || c->or_mask != c->x_or_mask || c->stepwise;
     return 0;
 }
 
-int main(int argc, char *argv[]) {
+/*  new_mode - the mode a file gets, from its old mode (with its type) or from its type alone
+*   when the mode does not depend on the old one
+*/
+static mode_t new_mode(mode_t old) {
+    if(S_ISDIR(old)) {
+        mode_t mode = (old & change.x_and_mask) | change.x_or_mask;
+        return (mode & ~change.dir_keep) | (old & change.dir_keep);
+    } else if(change.stepwise) {
+        mode_t mode = old;
+        for(int i = 0; i < change.num_ops; i++) {
+            struct mode_op *o = &change.ops[i];
+            mode = (mode & EXEC_BITS) ? (mode & o->x_and_mask) | o->x_or_mask : (mode & o->and_mask) | o->or_mask;
+        }
+        return mode;
+    } else if(old & EXEC_BITS) {
+        return (old & change.x_and_mask) | change.x_or_mask;
+    }
+    return (old & change.and_mask) | change.or_mask;
+}
 
-    if(argc == 1) {
-        fprintf(stderr, "chmod: missing operand\n");
-        print_usage();
-        exit(EXIT_FAILURE);
-    } else if(argc == 2) {
-        fprintf(stderr, "missing operand after '%s'\n", argv[1]);
-        print_usage();
-        exit(EXIT_FAILURE);
-    } else {
-        int result = 1;     
-        for(int i = 2; i < argc; i++) {
-            if(change_permission(argv[i], argv[1]) == -1) {
-                result = 0;     // if any error occurs, so that failed code is returned
+static void chmod_report(char *path, int error) {
+    fprintf(stderr, "chmod: cannot change '%s': %s\n", path, strerror(error));
+    any_error = 1;
+}
+
+/*  change_at - changes the mode of one file relative to a directory fd
+*   the old mode is read only if the mode needs it, type is the type of the file (like S_IFREG)
+*   links are not followed inside the tree, only the paths given as arguments are followed
+*/
+static int change_at(int dir_fd, char *name, mode_t type, int follow) {
+    mode_t mode = new_mode(type);
+    if(change.needs_old) {
+        struct stat statbuf;
+        if(fstatat(dir_fd, name, &statbuf, follow ? 0 : AT_SYMLINK_NOFOLLOW) == -1) {
+            return -1;
+        }
+        mode = new_mode(statbuf.st_mode);
+        if(mode == (statbuf.st_mode & 07777)) {     // nothing to change
+            return 0;
+        }
+    }
+    return fchmodat(dir_fd, name, mode, 0);
+}
+
+/*  chmod_dir - an open directory of the tree, shared by the tasks of its subdirectories
+*   if its new mode would not let us read it, it is changed when the last of them is done
+*/
+struct chmod_dir {
+    DIR *stream;
+    char *path;
+    int change_last;
+    mode_t mode;
+    atomic_int refs;
+};
+
+/*  chmod_task - a directory of the tree, relative to its parent or to the current directory
+*/
+struct chmod_task {
+    struct chmod_dir *parent;
+    char *name;
+    char *path;
+};
+
+static struct pool *walk_pool;
+
+static void release_chmod_dir(struct chmod_dir *dir) {
+    if(dir != NULL && atomic_fetch_sub(&dir->refs, 1) == 1) {
+        if(dir->change_last && fchmod(dirfd(dir->stream), dir->mode) == -1) {
+            chmod_report(dir->path, errno);
+        }
+        closedir(dir->stream);
+        free(dir->path);
+        free(dir);
+    }
+}
+
+static void free_chmod_task(struct chmod_task *t) {
+    if(t->parent != NULL) {         // the arguments are not copied
+        free(t->name);
+    }
+    free(t->path);
+    free(t);
+}
+
+static void chmod_dir_task(void *arg);
+
+/*  chmod_spawn - hands the task to the pool, or runs it right here if it cannot be queued
+*/
+static void chmod_spawn(struct chmod_task *t) {
+    if(walk_pool == NULL || pool_submit(walk_pool, chmod_dir_task, t) == -1) {
+        chmod_dir_task(t);
+    }
+}
+
+/*  chmod_dir_task - changes a directory and every file in it, the subdirectories are spawned as tasks
+*   a directory which stays readable is changed before it is read, so that a tree we cannot read
+*   yet can be fixed, the others are changed after everything inside them
+*/
+static void chmod_dir_task(void *arg) {
+    struct chmod_task *t = arg;
+    int parent_fd = t->parent ? dirfd(t->parent->stream) : AT_FDCWD;
+    int follow = (t->parent == NULL);
+    mode_t mode = new_mode(S_IFDIR);
+    if(change.needs_old || change.dir_keep) {
+        struct stat statbuf;
+        if(fstatat(parent_fd, t->name, &statbuf, follow ? 0 : AT_SYMLINK_NOFOLLOW) == -1) {
+            chmod_report(t->path, errno);
+            release_chmod_dir(t->parent);
+            free_chmod_task(t);
+            return;
+        }
+        mode = new_mode(statbuf.st_mode);
+    }
+    int change_last = (mode & (S_IRUSR | S_IXUSR)) != (S_IRUSR | S_IXUSR);
+    if(!change_last && fchmodat(parent_fd, t->name, mode, 0) == -1) {
+        chmod_report(t->path, errno);
+    }
+
+    int fd = openat(parent_fd, t->name, O_RDONLY | O_DIRECTORY | O_CLOEXEC | (follow ? 0 : O_NOFOLLOW));
+    DIR *stream = (fd == -1) ? NULL : fdopendir(fd);
+    struct chmod_dir *dir = (stream == NULL) ? NULL : malloc(sizeof(struct chmod_dir));
+    if(dir == NULL) {
+        chmod_report(t->path, stream == NULL ? errno : ENOMEM);
+        if(stream != NULL) {
+            closedir(stream);
+        } else if(fd != -1) {
+            close(fd);
+        }
+        if(change_last && fchmodat(parent_fd, t->name, mode, 0) == -1) {
+            chmod_report(t->path, errno);
+        }
+        release_chmod_dir(t->parent);
+        free_chmod_task(t);
+        return;
+    }
+    release_chmod_dir(t->parent);
+    dir->stream = stream;
+    dir->path = t->path;        // the directory takes over the path of its task
+    t->path = NULL;
+    dir->change_last = change_last;
+    dir->mode = mode;
+    atomic_init(&dir->refs, 1);     // held by this task until all the entries are done
+    free_chmod_task(t);
+
+    struct dirent *entry;
+    while(!command_interrupted && (entry = readdir(stream)) != NULL) {
+        char *name = entry->d_name;
+        if(strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+            continue;
+        }
+        unsigned char type = entry->d_type;
+        if(type == DT_UNKNOWN) {
+            struct stat statbuf;
+            if(fstatat(fd, name, &statbuf, AT_SYMLINK_NOFOLLOW) == -1) {
+                continue;
+            }
+            type = S_ISDIR(statbuf.st_mode) ? DT_DIR : S_ISLNK(statbuf.st_mode) ? DT_LNK : DT_REG;
+        }
+        if(type == DT_LNK) {        // the mode of a link cannot be changed, and it is not followed
+            continue;
+        } else if(type != DT_DIR) {
+            if(change_at(fd, name, S_IFREG, 0) == -1) {
+                char *path = make_path(dir->path, name);
+                chmod_report(path ? path : name, errno);
+                free(path);
             }
+            continue;
+        }
+
+        struct chmod_task *child = malloc(sizeof(struct chmod_task));
+        char *child_name = strdup(name);
+        char *path = make_path(dir->path, name);
+        if(child == NULL || child_name == NULL || path == NULL) {
+            chmod_report(dir->path, ENOMEM);
+            free(child);
+            free(child_name);
+            free(path);
+            break;
         }
-        if(!result) {
-            exit(EXIT_FAILURE);
+        child->parent = dir;
+        child->name = child_name;
+        child->path = path;
+        atomic_fetch_add(&dir->refs, 1);
+        chmod_spawn(child);
+    }
+    release_chmod_dir(dir);
+}
+
+/* change_permission - changes the permissions of the file with the compiled mode
+*  with -R, a directory is walked by all the workers of the pool
+*/
+static int change_permission(char *file) {
+    struct stat statbuf;
+    if(stat(file, &statbuf) == -1) {
+        chmod_report(file, errno);
+        return -1;
+    }
+    if(!recursive || !S_ISDIR(statbuf.st_mode)) {
+        if(fchmodat(AT_FDCWD, file, new_mode(statbuf.st_mode), 0) == -1) {
+            chmod_report(file, errno);
+            return -1;
         }
+        return 0;
     }
-    exit(EXIT_SUCCESS);
-}
\ No newline at end of file
+
+    struct chmod_task *t = malloc(sizeof(struct chmod_task));
+    if(t == NULL || (t->path = strdup(file)) == NULL) {
+        free(t);
+        chmod_report(file, ENOMEM);
+        return -1;
+    }
+    t->parent = NULL;
+    t->name = file;
+    chmod_spawn(t);
+    return 0;
+}
+
+int chmod_main(int argc, char *argv[]) {
+
+    int opt;
+    recursive = 0;
+    optind = 0;         // getopt starts over, since the shell calls chmod_main many times
+    while ((opt = getopt(argc, argv, "R")) != -1) {
+        switch (opt) {
+        case 'R': recursive = 1; break;
+        default:
+            print_usage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    if(argc - optind == 0) {
+        fprintf(stderr, "chmod: missing operand\n");
+        print_usage();
+        return EXIT_FAILURE;
+    } else if(argc - optind == 1) {
+        fprintf(stderr, "missing operand after '%s'\n", argv[optind]);
+        print_usage();
+        return EXIT_FAILURE;
+    }
+    change.ops = NULL;
+    if(compile_mode(argv[optind], &change) == -1) {
+        fprintf(stderr, "chmod: invalid mode: '%s'\n", argv[optind]);
+        free(change.ops);
+        return EXIT_FAILURE;        // an invalid mode stops chmod for all the files
+    }
+
+    any_error = 0;
+    walk_pool = recursive ? pool_create(pool_default_workers()) : NULL;     // if it is NULL, the walk runs on this thread
+    for(int i = optind + 1; i < argc && !command_interrupted; i++) {
+        change_permission(argv[i]);
+    }
+    if(walk_pool != NULL) {
+        pool_wait(walk_pool);
+        pool_destroy(walk_pool);
+        walk_pool = NULL;
+    }
+    free(change.ops);
+    if(command_interrupted) {
+        return INTERRUPTED_STATUS;
+    }
+    return any_error ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+#ifndef NEOSH_BUILTIN
+int main(int argc, char *argv[]) {
+    return chmod_main(argc, argv);
+}
+#endif
@@ -0,0 +1,589 @@
+/*  Author: Dishank Goel
+*   Date written: 21st August 2020
+*
+*   Copying files inside the kernel, read more in copy.h
+*/
+
+#define _GNU_SOURCE     // Declared for copy_file_range
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <linux/fs.h>
+#include "copy.h"
+#include "pool.h"
+#include "util.h"
+
+#define COPY_BUFFER_SIZE (1 << 20)      // buffer of the read/write loop, when nothing else works
+
+/*  unsupported - the errors telling that a way of copying does not work for these files,
+*   so the next one is tried. Any other error is a real failure of the copy
+*/
+static int unsupported(int error) {
+    return error == EXDEV || error == EINVAL || error == ENOSYS || error == EOPNOTSUPP || error == EBADF;
+}
+
+/*  write_all - writes the whole buffer at offset, write may write less than asked
+*/
+static int write_all(int out, char *buffer, size_t length, off_t offset) {
+    size_t written = 0;
+    while(written < length) {
+        ssize_t n = pwrite(out, buffer + written, length - written, offset + written);
+        if(n == -1 && errno != EINTR) {
+            return -1;
+        }
+        written += (n == -1) ? 0 : n;
+    }
+    return 0;
+}
+
+/*  is_zero - if the block has only zero bytes, so it can be left as a hole
+*/
+static int is_zero(char *buffer, size_t length) {
+    return length == 0 || (buffer[0] == 0 && memcmp(buffer, buffer + 1, length - 1) == 0);
+}
+
+/*  copy_read_write - the last resort, copies through a buffer until the end of the file
+*   starts at the current offset of in, and at the same offset in out
+*   for a sparse source, blocks of zeros are skipped instead of written, so they stay holes
+*/
+static int copy_read_write(int in, int out, int sparse) {
+    char *buffer = malloc(COPY_BUFFER_SIZE);
+    off_t offset = lseek(in, 0, SEEK_CUR);
+    if(buffer == NULL) {
+        return -1;
+    }
+    if(offset == -1) {
+        offset = 0;
+    }
+    ssize_t nread;
+    int skipped = 0;        // if the end of out is a hole, which has to be made by ftruncate
+    while((nread = read(in, buffer, COPY_BUFFER_SIZE)) != 0) {
+        if(command_interrupted) {
+            free(buffer);
+            errno = EINTR;
+            return -1;
+        }
+        if(nread == -1) {
+            if(errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        skipped = sparse && is_zero(buffer, nread);
+        if(!skipped && write_all(out, buffer, nread, offset) == -1) {
+            free(buffer);
+            return -1;
+        }
+        offset += nread;
+    }
+    free(buffer);
+    if(nread == 0 && skipped && ftruncate(out, offset) == -1) {
+        return -1;
+    }
+    return nread == -1 ? -1 : 0;
+}
+
+/*  copy_range - copies length bytes at offset from in to the same offset in out
+*/
+static int copy_range(int in, int out, off_t offset, off_t length) {
+    off_t in_offset = offset, out_offset = offset;
+    ssize_t n = 0;
+    while(length > 0 && !command_interrupted && (n = copy_file_range(in, &in_offset, out, &out_offset, length, 0)) > 0) {
+        length -= n;
+    }
+    if(command_interrupted) {
+        errno = EINTR;
+        return -1;
+    }
+    if(n == -1 && !unsupported(errno)) {
+        return -1;
+    }
+    if(length == 0 || n == 0) {     // n is 0 if the file got shorter meanwhile
+        return 0;
+    }
+
+    char *buffer = malloc(COPY_BUFFER_SIZE);
+    if(buffer == NULL) {
+        return -1;
+    }
+    while(length > 0) {
+        if(command_interrupted) {
+            free(buffer);
+            errno = EINTR;
+            return -1;
+        }
+        n = pread(in, buffer, length < COPY_BUFFER_SIZE ? length : COPY_BUFFER_SIZE, in_offset);
+        if(n == -1 && errno == EINTR) {
+            continue;
+        }
+        if(n <= 0) {        // a read error, or the file got shorter meanwhile
+            break;
+        }
+        if(write_all(out, buffer, n, in_offset) == -1) {
+            free(buffer);
+            return -1;
+        }
+        in_offset += n;
+        length -= n;
+    }
+    free(buffer);
+    return n == -1 ? -1 : 0;
+}
+
+/*  copy_sparse - copies only the data of a sparse file, the segments of data are found with
+*   SEEK_DATA and SEEK_HOLE. The holes between them are never written, so they stay holes in out,
+*   which is truncated to the full size at the end (that makes the hole at the end, if any)
+*   returns 1 if the file system cannot find the holes, so the file has to be copied another way
+*/
+static int copy_sparse(int in, int out, off_t size) {
+    off_t data = 0;
+    while(data < size) {
+        data = lseek(in, data, SEEK_DATA);
+        if(data == -1) {
+            if(errno == ENXIO) {        // there is only a hole till the end
+                break;
+            }
+            return unsupported(errno) ? 1 : -1;
+        }
+        off_t hole = lseek(in, data, SEEK_HOLE);
+        if(hole == -1) {
+            return -1;
+        }
+        if(copy_range(in, out, data, hole - data) == -1) {
+            return -1;
+        }
+        data = hole;
+    }
+    return ftruncate(out, size);
+}
+
+/*  copy_fd - copies the contents of in into out, which has to be empty
+*   source is the stat of in, every way continues from where the previous one stopped
+*   a sparse source (less blocks allocated than its size) only has its data copied
+*   returns -1 and sets errno on failure
+*/
+int copy_fd(int in, int out, const struct stat *source) {
+    off_t size = source->st_size;
+    off_t copied = 0;
+    ssize_t n = 0;
+    int sparse = S_ISREG(source->st_mode) && source->st_blocks * 512 < size;    // st_blocks is in 512 byte units
+
+    if(size > 0 && ioctl(out, FICLONE, in) == 0) {      // the file systems share the blocks (btrfs, xfs)
+        return 0;
+    }
+    if(sparse) {
+        int result = copy_sparse(in, out, size);
+        if(result != 1) {
+            return result;
+        }
+        return copy_read_write(in, out, 1);     // the zero blocks are found by reading them
+    }
+
+    while(copied < size && !command_interrupted && (n = copy_file_range(in, NULL, out, NULL, size - copied, 0)) > 0) {
+        copied += n;
+    }
+    if(n == -1 && !unsupported(errno)) {
+        return -1;
+    }
+    n = 0;
+    while(copied < size && !command_interrupted && (n = sendfile(out, in, NULL, size - copied)) > 0) {
+        copied += n;
+    }
+    if(command_interrupted) {       // read more in util.h
+        errno = EINTR;
+        return -1;
+    }
+    if(n == -1 && !unsupported(errno)) {
+        return -1;
+    }
+    if(size > 0 && copied == size) {
+        return 0;
+    }
+    /*  files reporting no size (like in /proc) or that could not be copied in the kernel */
+    return copy_read_write(in, out, 0);
+}
+
+/*  copy_owner - the copy gets the owner and group of the source, only root can give away files
+*   so for everyone else EPERM is not an error and the copy stays theirs
+*/
+static int copy_owner(int fd, const struct stat *source) {
+    if(fchown(fd, source->st_uid, source->st_gid) == -1 && errno != EPERM) {
+        return -1;
+    }
+    return 0;
+}
+
+/*  copy_file_at - copies the file old into new, both relative to their directory fds
+*   new is created with the permissions of old (less the umask, unless flags has COPY_MODE)
+*   or truncated if it exists, with COPY_METADATA it gets the owner and times of old too
+*   returns -1 and sets errno on failure
+*/
+int copy_file_at(int old_dirfd, const char *old, int new_dirfd, const char *new, int flags) {
+    int in = openat(old_dirfd, old, O_RDONLY | O_CLOEXEC);
+    if(in == -1) {
+        return -1;
+    }
+    struct stat statbuf;
+    if(fstat(in, &statbuf) == -1) {
+        int error = errno;
+        close(in);
+        errno = error;
+        return -1;
+    }
+    int out = openat(new_dirfd, new, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, statbuf.st_mode & 0777);
+    if(out == -1) {
+        int error = errno;
+        close(in);
+        errno = error;
+        return -1;
+    }
+
+    int result = copy_fd(in, out, &statbuf);
+    if(result == 0 && (flags & COPY_METADATA)) {      // before the mode, chown clears the setuid bit
+        result = copy_owner(out, &statbuf);
+    }
+    if(result == 0 && (flags & COPY_MODE)) {
+        result = fchmod(out, statbuf.st_mode & 07777);
+    }
+    if(result == 0 && (flags & COPY_METADATA)) {
+        result = futimens(out, (struct timespec[2]){statbuf.st_atim, statbuf.st_mtim});
+    }
+    int error = errno;
+    close(in);
+    if(close(out) == -1 && result == 0) {       // delayed write errors show up on close
+        return -1;
+    }
+    errno = error;
+    return result;
+}
+
+/*  copy_link_at - symbolic links are copied as links, pointing to the same target
+*   with COPY_METADATA the link itself gets the owner and times of the old one
+*/
+int copy_link_at(int old_dirfd, const char *old, int new_dirfd, const char *new, int flags) {
+    char target[PATH_MAX];
+    ssize_t n = readlinkat(old_dirfd, old, target, sizeof(target) - 1);
+    if(n == -1) {
+        return -1;
+    }
+    target[n] = '\0';
+    if(symlinkat(target, new_dirfd, new) == -1) {
+        return -1;
+    }
+    if(flags & COPY_METADATA) {
+        struct stat statbuf;
+        if(fstatat(old_dirfd, old, &statbuf, AT_SYMLINK_NOFOLLOW) == -1) {
+            return -1;
+        }
+        if(fchownat(new_dirfd, new, statbuf.st_uid, statbuf.st_gid, AT_SYMLINK_NOFOLLOW) == -1 && errno != EPERM) {
+            return -1;
+        }
+        struct timespec times[2] = {statbuf.st_atim, statbuf.st_mtim};
+        return utimensat(new_dirfd, new, times, AT_SYMLINK_NOFOLLOW);
+    }
+    return 0;
+}
+
+/*  copy_file - copies the file old into new, paths relative to the current directory
+*/
+int copy_file(char *old, char *new) {
+    return copy_file_at(AT_FDCWD, old, AT_FDCWD, new, 0);
+}
+
+/*  tree_copy - the state of one copy_tree, shared by all of its tasks
+*/
+struct tree_copy {
+    struct pool *pool;
+    char *program;          // prefix of the error messages, like "cp"
+    int flags;
+    mode_t mask;            // umask of the process, read once before the workers start
+    atomic_int error;
+};
+
+/*  copy_dir - a source directory and its copy, both open, shared by the tasks of the entries
+*   which open them relative to these fds. When the last task is done, the copy gets the
+*   permissions of the source (it stays writable until then, so the entries can be created)
+*/
+struct copy_dir {
+    DIR *source;
+    int target;
+    mode_t mode;
+    int keep_times;                 // COPY_METADATA, the times are set last since every entry copied changes them
+    struct timespec times[2];
+    char *path;             // path of the source, for the error messages
+    atomic_int refs;
+};
+
+/*  copy_task - one entry of the tree being copied
+*   the names are relative to the fds of dir, or to the current directory for the top of the tree
+*/
+struct copy_task {
+    struct tree_copy *copy;
+    struct copy_dir *dir;
+    char *old, *new;
+    char *path;
+};
+
+static void release_copy_dir(struct copy_dir *dir) {
+    if(dir != NULL && atomic_fetch_sub(&dir->refs, 1) == 1) {
+        fchmod(dir->target, dir->mode);
+        if(dir->keep_times) {
+            futimens(dir->target, dir->times);
+        }
+        close(dir->target);
+        closedir(dir->source);
+        free(dir->path);
+        free(dir);
+    }
+}
+
+static void free_copy_task(struct copy_task *t) {
+    if(t->dir != NULL) {        // below the top, old and new are one copy of the name
+        free(t->old);
+    }
+    free(t->path);
+    free(t);
+}
+
+static void copy_report(struct tree_copy *copy, char *path, int error) {
+    if(!command_interrupted) {      // after Ctrl-C the copy stops quietly, but it still failed
+        fprintf(stderr, "%s: cannot copy '%s': %s\n", copy->program, path, strerror(error));
+    }
+    copy->error = 1;
+}
+
+/*  copy_spawn - hands the task to the pool, or runs it right here if it cannot be queued
+*/
+static void copy_spawn(task_fn fn, struct copy_task *t) {
+    if(t->copy->pool == NULL || pool_submit(t->copy->pool, fn, t) == -1) {
+        fn(t);
+    }
+}
+
+/*  copy_file_task - copies one regular file of the tree
+*/
+static void copy_file_task(void *arg) {
+    struct copy_task *t = arg;
+    int old_dirfd = t->dir ? dirfd(t->dir->source) : AT_FDCWD;
+    int new_dirfd = t->dir ? t->dir->target : AT_FDCWD;
+    if(command_interrupted) {
+        t->copy->error = 1;
+    } else if(copy_file_at(old_dirfd, t->old, new_dirfd, t->new, t->copy->flags) == -1) {
+        copy_report(t->copy, t->path, errno);
+    }
+    release_copy_dir(t->dir);
+    free_copy_task(t);
+}
+
+/*  copy_dir_task - creates the copy of a directory and spawns a task for every entry
+*   the type of the entry comes from d_type, only if the file system does not fill it
+*   we need a fstatat
+*/
+static void copy_dir_task(void *arg) {
+    struct copy_task *t = arg;
+    struct tree_copy *copy = t->copy;
+    int old_dirfd = t->dir ? dirfd(t->dir->source) : AT_FDCWD;
+    int new_dirfd = t->dir ? t->dir->target : AT_FDCWD;
+
+    struct copy_dir *dir = malloc(sizeof(struct copy_dir));
+    int nofollow = t->dir ? O_NOFOLLOW : 0;     // the top of the tree can be a link, like on the command line
+    int source = openat(old_dirfd, t->old, O_RDONLY | O_DIRECTORY | nofollow | O_CLOEXEC);
+    struct stat statbuf;
+    int error = ENOMEM;
+    if(command_interrupted) {
+        error = EINTR;
+    } else if(dir == NULL || source == -1 || fstat(source, &statbuf) == -1) {
+        error = (dir == NULL) ? ENOMEM : errno;
+    } else if(mkdirat(new_dirfd, t->new, 0700) == -1 && errno != EEXIST) {   // copying into an existing directory merges them
+        error = errno;
+    } else if((dir->target = openat(new_dirfd, t->new, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1) {
+        error = errno;
+    } else if((dir->source = fdopendir(source)) == NULL) {
+        error = errno;
+        close(dir->target);
+    } else {
+        error = 0;
+    }
+    release_copy_dir(t->dir);
+    if(error) {
+        copy_report(copy, t->path, error);
+        if(source != -1) {
+            close(source);
+        }
+        free(dir);
+        free_copy_task(t);
+        return;
+    }
+
+    dir->keep_times = copy->flags & COPY_METADATA;
+    if(dir->keep_times) {
+        copy_owner(dir->target, &statbuf);
+        dir->times[0] = statbuf.st_atim;
+        dir->times[1] = statbuf.st_mtim;
+    }
+    dir->mode = statbuf.st_mode & 07777;
+    if(!(copy->flags & COPY_MODE)) {
+        dir->mode &= ~copy->mask;
+    }
+    fchmod(dir->target, dir->mode | S_IRWXU);       // writable until all the entries are copied
+    dir->path = t->path;        // the directory takes over the path of its task
+    t->path = NULL;
+    atomic_init(&dir->refs, 1);     // held by this task until all the entries are spawned
+    free_copy_task(t);
+
+    struct dirent *entry;
+    while((entry = readdir(dir->source)) != NULL) {
+        if(command_interrupted) {       // the entries left are not copied, the copy failed
+            copy->error = 1;
+            break;
+        }
+        char *name = entry->d_name;
+        if(strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+            continue;
+        }
+        char *path = make_path(dir->path, name);
+        unsigned char type = entry->d_type;
+        if(type == DT_UNKNOWN) {
+            struct stat entry_stat;
+            if(fstatat(dirfd(dir->source), name, &entry_stat, AT_SYMLINK_NOFOLLOW) == -1) {
+                copy_report(copy, path, errno);
+                free(path);
+                continue;
+            }
+            type = S_ISDIR(entry_stat.st_mode) ? DT_DIR : S_ISREG(entry_stat.st_mode) ? DT_REG :
+                   S_ISLNK(entry_stat.st_mode) ? DT_LNK : DT_UNKNOWN;
+        }
+
+        if(type == DT_LNK) {
+            if(copy_link_at(dirfd(dir->source), name, dir->target, name, copy->flags) == -1) {
+                copy_report(copy, path, errno);
+            }
+            free(path);
+            continue;
+        } else if(type != DT_DIR && type != DT_REG) {
+            copy_report(copy, path, ENOTSUP);       // devices, fifos and sockets are not copied
+            free(path);
+            continue;
+        }
+
+        struct copy_task *child = malloc(sizeof(struct copy_task));
+        char *child_name = strdup(name);
+        if(child == NULL || child_name == NULL || path == NULL) {
+            copy_report(copy, dir->path, ENOMEM);
+            free(child);
+            free(child_name);
+            free(path);
+            break;
+        }
+        child->copy = copy;
+        child->dir = dir;
+        child->old = child->new = child_name;
+        child->path = path;
+        atomic_fetch_add(&dir->refs, 1);
+        copy_spawn(type == DT_DIR ? copy_dir_task : copy_file_task, child);
+    }
+    release_copy_dir(dir);
+}
+
+/*  inside_tree - if the path new is the directory old or below it, a copy of old into new would copy
+*   itself forever. new may not exist yet, then its parent is checked. The directories from there
+*   up to / are opened with .. and each is compared with old by its device and inode
+*   returns 1 if it is inside, 0 if not, -1 and sets errno if old or the parent of new cannot be read
+*/
+static int inside_tree(char *old, char *new) {
+    struct stat top, statbuf;
+    if(stat(old, &top) == -1) {
+        return -1;
+    }
+    int fd = open(new, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if(fd == -1) {
+        char *name = base_name(new);
+        size_t length = strlen(new);
+        while(length > 1 && new[length - 1] == '/') {
+            length--;
+        }
+        char *parent = (name == NULL) ? NULL : strndup(new, length - strlen(name));
+        free(name);
+        if(parent == NULL) {
+            errno = ENOMEM;
+            return -1;
+        }
+        fd = open(parent[0] == '\0' ? "." : parent, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        free(parent);
+        if(fd == -1) {
+            return -1;
+        }
+    }
+    while(fstat(fd, &statbuf) == 0) {
+        if(statbuf.st_dev == top.st_dev && statbuf.st_ino == top.st_ino) {
+            close(fd);
+            return 1;
+        }
+        int up = openat(fd, "..", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        struct stat up_stat;
+        if(up == -1 || fstat(up, &up_stat) == -1 ||
+           (up_stat.st_dev == statbuf.st_dev && up_stat.st_ino == statbuf.st_ino)) {   // / is its own parent
+            if(up != -1) {
+                close(up);
+            }
+            break;
+        }
+        close(fd);
+        fd = up;
+    }
+    close(fd);
+    return 0;
+}
+
+/*  copy_tree - copies the directory old with everything inside it to new
+*   every directory is read by one task, which spawns a task for each of its files and
+*   subdirectories, these are run by a pool of workers. Symbolic links inside it are copied as links,
+*   old itself is followed if it is a link to a directory, and it is never copied into itself
+*   errors are printed with program as prefix, returns -2 if there was any, 0 otherwise
+*/
+int copy_tree(char *old, char *new, char *program, int flags) {
+    int inside = inside_tree(old, new);
+    if(inside != 0) {
+        if(inside == 1) {
+            fprintf(stderr, "%s: cannot copy a directory, '%s', into itself, '%s'\n", program, old, new);
+        } else {
+            fprintf(stderr, "%s: cannot copy '%s': %s\n", program, old, strerror(errno));
+        }
+        return -2;
+    }
+
+    struct tree_copy copy;
+    copy.program = program;
+    copy.flags = flags;
+    copy.mask = umask(0);
+    umask(copy.mask);
+    copy.pool = pool_create(pool_default_workers());        // if it is NULL, the copy runs on this thread
+    atomic_init(&copy.error, 0);
+
+    struct copy_task *t = malloc(sizeof(struct copy_task));
+    if(t == NULL || (t->path = strdup(old)) == NULL) {
+        free(t);
+        copy_report(&copy, old, ENOMEM);
+    } else {
+        t->copy = &copy;
+        t->dir = NULL;
+        t->old = old;
+        t->new = new;
+        copy_spawn(copy_dir_task, t);
+    }
+
+    if(copy.pool != NULL) {
+        pool_wait(copy.pool);
+        pool_destroy(copy.pool);
+    }
+    return copy.error ? -2 : 0;
+}
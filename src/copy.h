@@ -0,0 +1,27 @@
+/*  Author: Dishank Goel
+*   Date written: 21st August 2020
+*
+*   Copying files inside the kernel, used by cp
+*   The contents are copied by the cheapest way the file systems allow:
+*   a reflink (FICLONE) shares the blocks without copying them, then copy_file_range and sendfile
+*   copy inside the kernel, and only if none of them work, a read/write loop with a big buffer
+*   Sparse files only have their data copied, the holes stay holes in the copy
+*   Directory trees are copied by a pool of workers, read more in copy.c
+*/
+
+#ifndef NEOSH_COPY_H
+#define NEOSH_COPY_H
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#define COPY_MODE 1         // the copy gets exactly the permissions of the source, ignoring the umask
+#define COPY_METADATA 2     // the copy gets the owner and times of the source too, like a moved file
+
+int copy_fd(int in, int out, const struct stat *source);
+int copy_file_at(int old_dirfd, const char *old, int new_dirfd, const char *new, int flags);
+int copy_link_at(int old_dirfd, const char *old, int new_dirfd, const char *new, int flags);
+int copy_file(char *old, char *new);
+int copy_tree(char *old, char *new, char *program, int flags);
+
+#endif
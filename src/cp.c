@@ -1,7 +1,7 @@
 /*  Author: Dishank Goel
 *   Date written: 21st August 2020
 *   
-*   cp.c implements the `cp` command in UNIX with -r option to copy directories
+*   cp.c implements the `cp` command in UNIX with -r option to copy directories recursively
 *   cp is used to copy files or directories to new places
 *   Usage: ./cp [-r] SOURCE DEST\n");
 *   or:    ./cp [-r] SOURCE... DIRECTORY\n");
@@ -17,76 +17,36 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include "util.h"
+#include "copy.h"
+#include "builtins.h"
 
-bool move_directory = false;        // check if -r option is supplied or not
+static bool move_directory = false;        // check if -r option is supplied or not
 
-int print_usage() {
+static int print_usage() {
     fprintf(stderr, "Usage: cp [-r] SOURCE DEST\n");
     fprintf(stderr, "or:    cp [-r] SOURCE... DIRECTORY\n");
-    exit(EXIT_FAILURE);
-}
-
-/* copy_file - reads the content of one file, and create a new one to copy into
-*/
-int copy_file(char *old, char *new) {
-    FILE *source, *target;
-    char ch;
-    source = fopen(old, "r");
-    target = fopen(new, "w");
-    if(source == NULL) { return -1; }
-    if(target == NULL) { return -1; }
-    while( (ch = fgetc(source)) != EOF) {
-        fputc(ch, target);
-    }
-    fclose(source);
-    fclose(target);
-    return 0;
+    return EXIT_FAILURE;
 }
 
 /*  copy_into_dir - copies a file into a directory
 *   checks if the file being copied is a directory or normal file
 *   stat_old is check_dir status of file being copied
 *   new_path is the path inside the target directory where file is being copied
+*   a directory is copied with everything inside it by copy_tree (in copy.h), which walks it
+*   on all the cores and keeps the permissions and symbolic links
 */
-int copy_into_dir(char *path, char *new_path, int stat_old) {
-    int status;
+static int copy_into_dir(char *path, char *new_path, int stat_old) {
     if(stat_old && stat_old != -1) {  // We have to copy a directory into another directory
-        
-        mkdir(new_path, 0755);     // We create the new directory if it does not exist inside the target directory
-        /*  Read the contents of the older directory and copy each file into the new directory
-        *   Do not copy any directories inside the source directory 
-        */
-        struct dirent **namelist;
-        int n = scandir(path, &namelist, NULL, alphasort);
-        int i = 2;      // Skip '.' and '..'
-        while (i < n) {
-            char *old_file = make_path(path, namelist[i]->d_name);
-            int if_dir = check_dir(old_file);   // Checking the status of file in source directory
-            if(if_dir && if_dir != -1) {        // If the this file of the older directory is a directory, do not copy it
-                i++;
-            } else {
-                char *new_file = make_path(new_path, namelist[i]->d_name);
-                status = copy_file(old_file, new_file);     // We copy the regular file into its new location
-                i++;
-                free(new_file);
-            }
-            free(namelist[i]);
-            free(old_file);
-
-        }
-        free(namelist);
-
+        return copy_tree(path, new_path, "cp", COPY_MODE);      // errors are already printed, it returns -2
     } else {                        // We have to copy a file into target directory
-        status = copy_file(path, new_path);
+        return copy_file(path, new_path);
     }
-    return status;
-
 }
 
 /*  copy - handles all the cases for moving either a file or dir into a (file or dir)
 *   n is the check_dir status of target dir or file
 */
-int copy(char *old, char *new, int n) {
+static int copy(char *old, char *new, int n) {
     int result;
     int stat_old = check_dir(old);  
     if(stat_old && stat_old != -1) {    // The source file is a directory
@@ -100,7 +60,13 @@ int copy(char *old, char *new, int n) {
     }
     if(n && n != -1) {  // The target path is a directory
 
-        char *new_path = make_path(new, old);
+        char *name = base_name(old);
+        char *new_path = (name == NULL) ? NULL : make_path(new, name);     // the copy keeps the last name of the source
+        free(name);
+        if(new_path == NULL) {
+            fprintf(stderr, "cp: cannot copy '%s': %s\n", old, strerror(ENOMEM));
+            return -1;
+        }
         result = copy_into_dir(old, new_path, stat_old);
         free(new_path);
 
@@ -134,17 +100,20 @@ int copy(char *old, char *new, int n) {
     
 }
 
-int main(int argc, char *argv[])
+int cp_main(int argc, char *argv[])
 {   
     /*  getopt is used to parse for flags (options) in command line tokens
     *   if there is an option -r, move_directory is set to true
+    *   optind = 0 makes getopt start over, since the shell calls cp_main many times
     */
     int opt;
+    move_directory = false;
+    optind = 0;
     while ((opt = getopt(argc, argv, "r")) != -1) {     // loop over all the options
         switch (opt) {
         case 'r': move_directory = true; break;
         default:
-            print_usage();
+            return print_usage();
         }
     }
 
@@ -152,24 +121,36 @@ int main(int argc, char *argv[])
     If it is >= argc, there were no non-option arguments. */
 
     int num_nop_argument = argc - optind;       // number of non option arguments
+    int any_error = 0;
     if(num_nop_argument <= 1) {         // Atleast two non argument options are required to copy
-        print_usage();
+        return print_usage();
         
     } else if(num_nop_argument == 2) {
         int n = check_dir(argv[argc - 1]);
-        copy(argv[optind], argv[argc - 1], n);
+        any_error = (copy(argv[optind], argv[argc - 1], n) == -1);
     
     } else {
         int n = check_dir(argv[argc - 1]); 
         if(n && n != -1) {          // If multiple source dest are present, then target has to be a directory
-            for(int i = optind; i < argc - 1; i++) {
-                copy(argv[i], argv[argc - 1], n);
+            for(int i = optind; i < argc - 1 && !command_interrupted; i++) {
+                if(copy(argv[i], argv[argc - 1], n) == -1) {
+                    any_error = 1;
+                }
             }
         } else {
             fprintf(stderr, "cp: target '%s' is not a directory\n", argv[argc - 1]);
-            exit(EXIT_FAILURE);
+            return EXIT_FAILURE;
         }
     }
-    exit(EXIT_SUCCESS);
+    if(command_interrupted) {
+        return INTERRUPTED_STATUS;
+    }
+    return any_error ? EXIT_FAILURE : EXIT_SUCCESS;
+
+}
 
-}
\ No newline at end of file
+#ifndef NEOSH_BUILTIN
+int main(int argc, char *argv[]) {
+    return cp_main(argc, argv);
+}
+#endif
@@ -1,132 +1,624 @@
 /*  Author: Dishank Goel
 *   Date written: 21st August 2020
 *   
-*   grep.c implements the `grep` command in UNIX without any options
+*   grep.c implements the `grep` command in UNIX with -r option to search directories
 *   grep is used to search for patterns in text
-*   this implementation runs in O(m*n) m being text size, n is pattern length
-*   if no file is given, then grep takes input from stdin
-*   Usage: ./grep PATTERN [FILE]...
+*   the pattern is searched by a matcher compiled once for it, read more in match.h
+*   if no file is given, then grep takes input from stdin (or the current directory with -r)
+*   Usage: ./grep [-r] PATTERN [FILE]...
 */
 
+#define _GNU_SOURCE     // Declared for memrchr
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <poll.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <dirent.h>
 #include <errno.h>
 #include <string.h>
 #include "util.h"
+#include "match.h"
+#include "pool.h"
+#include "outbuf.h"
+#include "builtins.h"
 
-int multiple_args;
+#define BLOCK_SIZE (1 << 20)       // files that cannot be mapped are read 1 MiB at a time
+#define SEARCH_PART_SIZE (1 << 24)  // a mapped file is searched in parts this big, checking for Ctrl-C
+#define BINARY_PROBE 8192           // a NUL byte in this many bytes at the start marks a binary file
+
+static int multiple_args;
+static int skip_binary;         // with -r, binary files are skipped without searching them
+
+/*  is_binary - binary files are recognized by a NUL byte near the start, like in GNU grep
+*/
+static int is_binary(char *buffer, size_t length) {
+    return memchr(buffer, '\0', length < BINARY_PROBE ? length : BINARY_PROBE) != NULL;
+}
 
 /*  process_line - for each given to this function, it checks if there is a match
 *   if there is a match, it colors the match in the line and prints it
+*   the matcher is compiled once for the pattern, length is the length of the line
+*   the line is printed on out, which is a buffer in memory when files are searched in parallel
 */
-int process_line(char *pattern, char *line, char *file) {
+static int process_line(struct matcher *m, char *line, size_t length, char *file, struct outbuf *out) {
     int match_found = 0;        // if any printing is required
-    int n = strlen(pattern);
-    int m = strlen(line);
-    int last_match = 0;         // stores where the last match ended, so that we can print white from there to current match
-    
-    /*  loops over entire string and finds match 
-    *   O(m*n) naive matching algorithm
-    */
-    for(int i = 0; i < m - n; i++) {
-        int match = 1;
-        for(int j = 0; j < n; j++) {        // if there is a match starting at the ith position
-            if (pattern[j] != line[i + j] ) {
-                match = 0;
-                break;
-            }
+    size_t last_match = 0;      // stores where the last match ended, so that we can print white from there to current match
+    const char *match;
+
+    /*  the empty pattern matches every line, print it as it is */
+    if(m->length == 0) {
+        if(multiple_args) {
+            outbuf_color(out, file, strlen(file), PURPLE);
+            outbuf_color(out, ":", 1, CYAN);
+        }
+        outbuf_write(out, line, length);
+        if(length > 0 && line[length - 1] != '\n') {
+            outbuf_putc(out, '\n');
         }
-        if (match == 1) {       // if there was a match
+        return 0;
+    }
 
-            /*  if there are multiple files, print the filename like in UNIX grep
-            *   print it only once per line */
-            if(match_found == 0 && multiple_args) {      
-                print_color_string(file, PURPLE);   // print_color_string is in util.h
-                print_color_string(":", CYAN);
-            }
-            /*  print the string from ending of last match to the starting of current match in white */
-            printf("%.*s", i - last_match, line + last_match);
-            /*  then print the matched pattern */  
-            print_color_string(pattern, RED);
-            last_match = i + n;
-            match_found = 1;
+    /*  loops over the matches in the line, the search continues after the end of the last match */
+    while((match = m->find(m, line + last_match, length - last_match)) != NULL) {
+
+        /*  if there are multiple files, print the filename like in UNIX grep
+        *   print it only once per line */
+        if(match_found == 0 && multiple_args) {      
+            outbuf_color(out, file, strlen(file), PURPLE);   // outbuf_color is in outbuf.h
+            outbuf_color(out, ":", 1, CYAN);
         }
+        /*  print the string from ending of last match to the starting of current match in white */
+        outbuf_write(out, line + last_match, match - (line + last_match));
+        /*  then print the matched pattern */  
+        outbuf_color(out, m->pattern, m->length, RED);
+        last_match = match - line + m->length;
+        match_found = 1;
     }
     if (match_found) {      // print the remaining line 
-        printf("%.*s", m - last_match, line + last_match);
+        outbuf_write(out, line + last_match, length - last_match);
+        if(line[length - 1] != '\n') {     // the last line of a file may not end in newline
+            outbuf_putc(out, '\n');
+        }
     }
 
     return 0;
 
 }
 
-/*  handle_file - opens the file contents and reports any error while reading contents
-*   special case if file is directory are checked
+/*  search_buffer - searches the whole buffer for the pattern at once, instead of line by line
+*   only when there is a match, the boundaries of its line are found with memrchr and memchr
+*   and that line is printed. The buffer has to start at the beginning of a line
 */
+static void search_buffer(struct matcher *m, char *buffer, size_t length, char *file, struct outbuf *out) {
+    size_t pos = 0;         // the search restarts from here, always the start of a line
+    const char *match;
+    while(pos < length && (match = m->find(m, buffer + pos, length - pos)) != NULL) {
+        char *start = memrchr(buffer + pos, '\n', match - (buffer + pos));
+        start = (start == NULL) ? buffer + pos : start + 1;
+        char *end = memchr(match, '\n', buffer + length - match);
+        end = (end == NULL) ? buffer + length : end + 1;      // the last line may not end in newline
 
-int handle_file(char *pattern, char *file) {
-    FILE *fp = fopen(file, "r");
-    if (fp == NULL) {
-        fprintf(stderr, "grep: cannot open '%s': %s\n", file, strerror(errno));
-        exit(EXIT_FAILURE);     // exit as soon as a file cannot be opened, mentioned in wgrep
-    } else {
-        if (check_dir(file)) {
-            fprintf(stderr, "grep: cannot read '%s': Is a directory\n", file);
-        } else {
-            char *buffer = NULL;
-            size_t n;           //  Will contain the allocated size of the buffer
-            ssize_t nread;      //  The number of characters read from current line
-            while ((nread = getline(&buffer, &n, fp)) != -1) {
-                if (buffer != NULL) {
-                    process_line(pattern, buffer, file);    // process the fetched line (find matches)
-                }  
+        process_line(m, start, end - start, file, out);
+        pos = end - buffer;
+    }
+}
+
+/*  search_mmap - maps the whole file in memory and searches it with search_buffer
+*   returns -1 if the file cannot be mapped
+*/
+static int search_mmap(struct matcher *m, int fd, size_t size, char *file, struct outbuf *out) {
+    char *buffer = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(buffer == MAP_FAILED) {
+        return -1;
+    }
+    madvise(buffer, size, MADV_SEQUENTIAL);     // we read the file once from start to end
+    if(!skip_binary || !is_binary(buffer, size)) {
+        /*  a big file is searched in parts which end at a newline, so that Ctrl-C is seen between them */
+        size_t pos = 0;
+        while(pos < size && !command_interrupted) {
+            size_t end = size;
+            if(size - pos > SEARCH_PART_SIZE) {
+                char *newline = memchr(buffer + pos + SEARCH_PART_SIZE, '\n', size - pos - SEARCH_PART_SIZE);
+                end = (newline == NULL) ? size : newline + 1 - buffer;
             }
-            free(buffer);
+            search_buffer(m, buffer + pos, end - pos, file, out);
+            pos = end;
         }
     }
-    fclose(fp);
+    munmap(buffer, size);
     return 0;
 }
 
-/* grep_stdin - special case if no file is given, then open stdin and process the line
+/*  search_blocks - for files that cannot be mapped (pipes, /proc files), reads the file in big blocks
+*   and searches all the complete lines of a block at once. The incomplete line at the end of
+*   the block is moved to the front and completed by the next read
 */
-int grep_stdin(char *pattern) {
-    while (1) {
-        char line[4096];
-        if(fgets(line, 4096, stdin)) {
-            process_line(pattern, line, "");
+static int search_blocks(struct matcher *m, int fd, char *file, struct outbuf *out) {
+    size_t capacity = BLOCK_SIZE;
+    size_t filled = 0;
+    char *buffer = malloc(capacity);
+    if(buffer == NULL) {
+        return -1;
+    }
+
+    ssize_t nread;
+    int first_block = 1;
+    while(!command_interrupted && (nread = read(fd, buffer + filled, capacity - filled)) > 0) {
+        filled += nread;
+        if(first_block && skip_binary && is_binary(buffer, filled)) {
+            free(buffer);
+            return 0;
+        }
+        first_block = 0;
+        char *last_newline = memrchr(buffer, '\n', filled);
+        if(last_newline == NULL) {      // not even one complete line yet
+            if(filled == capacity) {    // the line is longer than the buffer
+                capacity *= 2;
+                char *bigger = realloc(buffer, capacity);
+                if(bigger == NULL) {
+                    free(buffer);
+                    return -1;
+                }
+                buffer = bigger;
+            }
+            continue;
+        }
+        size_t complete = last_newline + 1 - buffer;
+        search_buffer(m, buffer, complete, file, out);
+        memmove(buffer, buffer + complete, filled - complete);
+        filled -= complete;
+    }
+    if(filled > 0) {        // the last line did not end in newline
+        search_buffer(m, buffer, filled, file, out);
+    }
+    free(buffer);
+    return nread == -1 ? -1 : 0;
+}
+
+/*  print_error - prints an error of grep on err, after all the matches printed before it
+*/
+static void print_error(struct outbuf *out, struct outbuf *err, char *message, char *file, int error) {
+    outbuf_flush(out);
+    outbuf_printf(err, "grep: %s '%s': %s\n", message, file, strerror(error));
+    outbuf_flush(err);
+}
+
+/*  search_fd - searches an open file, special case if file is directory are checked
+*   regular files are mapped in memory, everything else is read in blocks
+*   matches are printed on out and errors on err
+*/
+static void search_fd(struct matcher *m, int fd, char *file, struct outbuf *out, struct outbuf *err) {
+    struct stat statbuf;
+    int stat_ok = (fstat(fd, &statbuf) == 0);      // without it the file is read in blocks, which needs no size
+    if (stat_ok && S_ISDIR(statbuf.st_mode)) {
+        print_error(out, err, "cannot read", file, EISDIR);
+    } else if (!stat_ok || !S_ISREG(statbuf.st_mode) || statbuf.st_size == 0 || search_mmap(m, fd, statbuf.st_size, file, out) == -1) {
+        if (search_blocks(m, fd, file, out) == -1) {
+            print_error(out, err, "cannot read", file, errno);
         }
     }
+}
+
+/*  handle_file - opens the file contents and reports any error while reading contents
+*/
+static int handle_file(struct matcher *m, char *file, struct outbuf *out, struct outbuf *err) {
+    int fd = open(file, O_RDONLY);
+    if (fd == -1) {
+        print_error(out, err, "cannot open", file, errno);
+        return -1;     // stop as soon as a file cannot be opened, mentioned in wgrep
+    }
+    search_fd(m, fd, file, out, err);
+    close(fd);
     return 0;
 }
 
-int main(int argc, char *argv[]) {
-    multiple_args = 0;
-    if(argc == 1) {
-        fprintf(stderr, "Usage: grep PATTERN [FILE]...\n");
-        exit(EXIT_FAILURE);
-    } else if (argc == 2) {
-        if(strcmp(argv[1], "\"\"") == 0) {      // if "" is given as the pattern, we treat it like empty string
-            grep_stdin("");
-        } else {
-            grep_stdin(argv[1]);
+/*  file_result - the output of grep for one file, kept in memory until all the files
+*   before it are printed, so that the output comes in the order of the arguments
+*/
+struct file_result {
+    struct matcher *m;
+    char *file;
+    struct outbuf out, err;     // buffers in memory for matches and errors
+    int status;
+    int done;
+};
+
+static pthread_mutex_t results_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t result_ready = PTHREAD_COND_INITIALIZER;
+
+/*  grep_file_task - runs on a worker of the pool, searches one file into memory
+*/
+static void grep_file_task(void *arg) {
+    struct file_result *r = arg;
+    r->status = command_interrupted ? 0 : handle_file(r->m, r->file, &r->out, &r->err);
+    if(r->out.error != 0 || r->err.error != 0) {
+        r->status = -2;
+    }
+
+    pthread_mutex_lock(&results_lock);
+    r->done = 1;
+    pthread_cond_broadcast(&result_ready);
+    pthread_mutex_unlock(&results_lock);
+}
+
+/*  grep_files_parallel - searches the files on a pool of threads, which take the files from
+*   a work stealing queue. The output of every file is printed as soon as it and all the files
+*   before it are done, so it is the same as searching them one by one
+*/
+static int grep_files_parallel(struct matcher *m, char *files[], int num_files, struct outbuf *out, struct outbuf *err) {
+    int num_workers = pool_default_workers();
+    if(num_workers > num_files) {
+        num_workers = num_files;
+    }
+    struct file_result *results = calloc(num_files, sizeof(struct file_result));
+    struct pool *pool = (results != NULL) ? pool_create(num_workers) : NULL;
+    if(pool == NULL) {      // no threads, search the files one by one
+        free(results);
+        for(int i = 0; i < num_files; i++) {
+            if(handle_file(m, files[i], out, err) == -1) {
+                return -1;
+            }
         }
-        
-    } else {
-        if (argc > 3) {
-            multiple_args = 1;
+        return 0;
+    }
+
+    for(int i = 0; i < num_files; i++) {
+        results[i].m = m;
+        results[i].file = files[i];
+        outbuf_init(&results[i].out, OUTBUF_MEMORY);
+        outbuf_init(&results[i].err, OUTBUF_MEMORY);
+        results[i].out.tty = out->tty;      // colored only if it will be printed on a terminal
+        if(pool_submit(pool, grep_file_task, &results[i]) == -1) {
+            grep_file_task(&results[i]);        // the queue is out of memory, search it here
         }
-        if(strcmp(argv[1], "\"\"") == 0) {          // Separate case for treating "" as an empty string
-            for(int i = 2; i < argc; i++) {
-                handle_file("", argv[i]);
+    }
+
+    int status = 0;
+    for(int i = 0; i < num_files; i++) {
+        struct file_result *r = &results[i];
+        pthread_mutex_lock(&results_lock);
+        while(!r->done) {
+            pthread_cond_wait(&result_ready, &results_lock);
+        }
+        pthread_mutex_unlock(&results_lock);
+
+        if(status == 0 && !command_interrupted) {       // after a file could not be opened, nothing more is printed
+            if(r->status == -2) {
+                print_error(out, err, "cannot read", r->file, ENOMEM);
+            } else {
+                outbuf_write(out, r->out.data, r->out.used);
+                if(r->err.used > 0) {       // the errors of this file come after its matches
+                    outbuf_flush(out);
+                    outbuf_write(err, r->err.data, r->err.used);
+                    outbuf_flush(err);
+                }
             }
+            status = r->status;
+        }
+        outbuf_free(&r->out);
+        outbuf_free(&r->err);
+    }
+    pool_destroy(pool);
+    free(results);
+    return status == 0 ? 0 : -1;
+}
+
+/*  dir_ref - an open directory, shared by the tasks of its entries which open them relative to it
+*   it is closed when the last of those tasks is done
+*/
+struct dir_ref {
+    DIR *stream;
+    char *path;
+    atomic_int refs;
+};
+
+/*  walk_task - one entry of the tree being searched with -r, either a file or a directory
+*   name is relative to dir, or to the current directory for the paths given as arguments
+*/
+struct walk_task {
+    struct dir_ref *dir;
+    char *name;
+    char *path;         // the path printed before the matches
+};
+
+static struct pool *walk_pool;
+static struct matcher *walk_matcher;
+static atomic_int walk_error;
+static struct outbuf *walk_out, *walk_err;      // shared by the workers, only used with output_lock held
+static pthread_mutex_t output_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void release_dir(struct dir_ref *dir) {
+    if(dir != NULL && atomic_fetch_sub(&dir->refs, 1) == 1) {
+        closedir(dir->stream);
+        free(dir->path);
+        free(dir);
+    }
+}
+
+static void free_walk_task(struct walk_task *t) {
+    if(t->dir != NULL) {        // the arguments are not copied
+        free(t->name);
+    }
+    free(t->path);
+    free(t);
+}
+
+/*  walk_spawn - hands the task to the pool, or runs it right here if it cannot be queued
+*/
+static void walk_spawn(task_fn fn, struct walk_task *t) {
+    if(walk_pool == NULL || pool_submit(walk_pool, fn, t) == -1) {
+        fn(t);
+    }
+}
+
+/*  walk_report - prints an error of the walk, the walk itself goes on
+*/
+static void walk_report(char *message, char *path, int error) {
+    pthread_mutex_lock(&output_lock);
+    print_error(walk_out, walk_err, message, path, error);
+    pthread_mutex_unlock(&output_lock);
+    walk_error = 1;
+}
+
+/*  walk_file_task - searches one file of the tree into memory, then prints it at once,
+*   so that the lines of different files are not mixed up
+*/
+static void walk_file_task(void *arg) {
+    struct walk_task *t = arg;
+    int nofollow = t->dir ? O_NOFOLLOW : 0;     // the paths given to grep are followed if they are links
+    int fd = openat(t->dir ? dirfd(t->dir->stream) : AT_FDCWD, t->name, O_RDONLY | nofollow | O_NOCTTY | O_CLOEXEC);
+    int error = errno;
+    release_dir(t->dir);
+    if(fd == -1 || command_interrupted) {
+        if(fd == -1) {
+            walk_report("cannot open", t->path, error);
         } else {
-            for(int i = 2; i < argc; i++) {
-                handle_file(argv[1], argv[i]);
+            close(fd);
+        }
+        free_walk_task(t);
+        return;
+    }
+
+    struct outbuf out, err;
+    outbuf_init(&out, OUTBUF_MEMORY);
+    outbuf_init(&err, OUTBUF_MEMORY);
+    out.tty = walk_out->tty;
+    search_fd(walk_matcher, fd, t->path, &out, &err);
+    close(fd);
+
+    if(out.error != 0 || err.error != 0) {
+        walk_report("cannot read", t->path, ENOMEM);
+    } else if(out.used > 0 || err.used > 0) {
+        pthread_mutex_lock(&output_lock);
+        outbuf_write(walk_out, out.data, out.used);
+        if(err.used > 0) {
+            outbuf_flush(walk_out);
+            outbuf_write(walk_err, err.data, err.used);
+            outbuf_flush(walk_err);
+        }
+        pthread_mutex_unlock(&output_lock);
+    }
+    outbuf_free(&out);
+    outbuf_free(&err);
+    free_walk_task(t);
+}
+
+/*  walk_dir_task - opens a directory relative to its parent and spawns a task for every entry
+*   the type of the entry comes from d_type, only if the file system does not fill it
+*   we need a fstatat. Symbolic links and special files inside the tree are skipped, only a path
+*   given on the command line is followed
+*/
+static void walk_dir_task(void *arg) {
+    struct walk_task *t = arg;
+    int nofollow = t->dir ? O_NOFOLLOW : 0;     // the paths given to grep are followed if they are links
+    int fd = openat(t->dir ? dirfd(t->dir->stream) : AT_FDCWD, t->name, O_RDONLY | O_DIRECTORY | nofollow | O_CLOEXEC);
+    int error = errno;
+    release_dir(t->dir);
+    DIR *stream = (fd == -1) ? NULL : fdopendir(fd);
+    struct dir_ref *dir = (stream == NULL) ? NULL : malloc(sizeof(struct dir_ref));
+    if(dir == NULL) {
+        walk_report("cannot open", t->path, fd == -1 ? error : errno);
+        if(stream != NULL) {
+            closedir(stream);
+        } else if(fd != -1) {
+            close(fd);
+        }
+        free_walk_task(t);
+        return;
+    }
+    dir->stream = stream;
+    dir->path = t->path;        // the directory takes over the path of its task
+    t->path = NULL;
+    atomic_init(&dir->refs, 1);     // held by this task until all the entries are spawned
+    free_walk_task(t);
+
+    struct dirent *entry;
+    while(!command_interrupted && (entry = readdir(stream)) != NULL) {
+        char *name = entry->d_name;
+        if(strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+            continue;
+        }
+        unsigned char type = entry->d_type;
+        if(type == DT_UNKNOWN) {
+            struct stat statbuf;
+            if(fstatat(dirfd(stream), name, &statbuf, AT_SYMLINK_NOFOLLOW) == -1) {
+                continue;
             }
+            type = S_ISDIR(statbuf.st_mode) ? DT_DIR : S_ISREG(statbuf.st_mode) ? DT_REG : DT_UNKNOWN;
+        }
+        if(type != DT_DIR && type != DT_REG) {
+            continue;
+        }
+
+        struct walk_task *child = malloc(sizeof(struct walk_task));
+        if(child == NULL) {
+            walk_report("cannot read", dir->path, ENOMEM);
+            break;
         }
+        child->dir = dir;
+        child->name = strdup(name);
+        child->path = (dir->path[0] == '\0') ? strdup(name) : make_path(dir->path, name);
+        atomic_fetch_add(&dir->refs, 1);
+        walk_spawn(type == DT_DIR ? walk_dir_task : walk_file_task, child);
     }
-    exit(EXIT_SUCCESS);
+    release_dir(dir);
+}
+
+/*  grep_recursive - searches every file under the given paths with -r
+*   without any path, the current directory is searched and the paths are printed relative to it
+*   the directories are walked by all the workers of the pool, a directory spawns the tasks for
+*   its entries, which are stolen by idle workers. The output of one file is never split, but the
+*   files are printed in the order they finish
+*/
+static int grep_recursive(struct matcher *m, char *paths[], int num_paths, struct outbuf *out, struct outbuf *err) {
+    walk_matcher = m;
+    walk_out = out;
+    walk_err = err;
+    walk_error = 0;
+    walk_pool = pool_create(pool_default_workers());        // if it is NULL, the walk runs on this thread
+
+    struct walk_task *current_dir = malloc(sizeof(struct walk_task));
+    if(num_paths == 0 && current_dir != NULL) {
+        current_dir->dir = NULL;
+        current_dir->name = ".";
+        current_dir->path = strdup("");
+        walk_spawn(walk_dir_task, current_dir);
+    } else {
+        free(current_dir);
+    }
+    for(int i = 0; i < num_paths && !command_interrupted; i++) {
+        struct stat statbuf;
+        if(stat(paths[i], &statbuf) == -1) {
+            walk_report("cannot open", paths[i], errno);
+            continue;
+        }
+        struct walk_task *t = malloc(sizeof(struct walk_task));
+        if(t == NULL) {
+            walk_report("cannot open", paths[i], ENOMEM);
+            continue;
+        }
+        t->dir = NULL;
+        t->name = paths[i];
+        t->path = strdup(paths[i]);
+        size_t length = strlen(t->path);
+        while(length > 1 && t->path[length - 1] == '/') {       // dir/ would print dir//file
+            t->path[--length] = '\0';
+        }
+        walk_spawn(S_ISDIR(statbuf.st_mode) ? walk_dir_task : walk_file_task, t);
+    }
+
+    if(walk_pool != NULL) {
+        pool_wait(walk_pool);
+        pool_destroy(walk_pool);
+        walk_pool = NULL;
+    }
+    return walk_error ? -1 : 0;
+}
+
+/* grep_stdin - special case if no file is given, then open stdin and process the line
+*  stops at the end of input, so that the shell gets back its prompt
+*  on a terminal every line is printed as soon as it is typed, and it waits for the next one with
+*  poll, which Ctrl-C interrupts even when the read of getline would be restarted
+*/
+static int grep_stdin(struct matcher *m, struct outbuf *out) {
+    char *line = NULL;
+    size_t n;
+    ssize_t nread;
+    int interactive = isatty(STDIN_FILENO);
+    while (1) {
+        if(interactive && stdin->_IO_read_ptr == stdin->_IO_read_end) {     // nothing buffered by stdio
+            struct pollfd input = {STDIN_FILENO, POLLIN, 0};
+            while(poll(&input, 1, -1) == -1 && errno == EINTR && !command_interrupted);
+        }
+        if(command_interrupted || (nread = getline(&line, &n, stdin)) == -1) {
+            break;
+        }
+        process_line(m, line, nread, "", out);
+        if(interactive) {
+            outbuf_flush(out);
+        }
+    }
+    free(line);
+    clearerr(stdin);        // the shell keeps reading from the same stdin after ^D
+    return 0;
+}
+
+static int print_usage() {
+    fprintf(stderr, "Usage: grep [-r] PATTERN [FILE]...\n");
+    return EXIT_FAILURE;
+}
+
+int grep_main(int argc, char *argv[]) {
+    multiple_args = 0;
+    skip_binary = 0;
+    int recursive = 0;
+
+    /*  getopt is used to parse for flags (options) in command line tokens
+    *   optind = 0 makes getopt start over, since the shell calls grep_main many times
+    */
+    int opt;
+    optind = 0;
+    while ((opt = getopt(argc, argv, "r")) != -1) {
+        switch (opt) {
+        case 'r': recursive = 1; break;
+        default:
+            return print_usage();
+        }
+    }
+    if(optind >= argc) {
+        return print_usage();
+    }
+
+    struct matcher m;
+    char *pattern = argv[optind];
+    if(strcmp(pattern, "\"\"") == 0) {      // if "" is given as the pattern, we treat it like empty string
+        compile_matcher(&m, "");
+    } else {
+        compile_matcher(&m, pattern);
+    }
+    char **files = argv + optind + 1;
+    int num_files = argc - optind - 1;
+
+    /*  the matches are written to stdout in big blocks, errors go out as soon as they happen */
+    struct outbuf out, err;
+    if(outbuf_init(&out, STDOUT_FILENO) == -1 || outbuf_init(&err, STDERR_FILENO) == -1) {
+        fprintf(stderr, "grep: %s\n", strerror(ENOMEM));
+        outbuf_free(&out);
+        return EXIT_FAILURE;
+    }
+    int status = 0;
+    if (recursive) {
+        multiple_args = 1;      // files are always printed with their path
+        skip_binary = 1;
+        status = grep_recursive(&m, files, num_files, &out, &err);
+    } else if (num_files == 0) {
+        status = grep_stdin(&m, &out);
+    } else if (num_files == 1) {
+        status = handle_file(&m, files[0], &out, &err);
+    } else {
+        multiple_args = 1;
+        status = grep_files_parallel(&m, files, num_files, &out, &err);
+    }
+    if(outbuf_flush(&out) == -1) {
+        fprintf(stderr, "grep: write error: %s\n", strerror(out.error));
+        status = -1;
+    }
+    outbuf_free(&out);
+    outbuf_free(&err);
+    if(command_interrupted) {
+        return INTERRUPTED_STATUS;
+    }
+    return status == -1 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+#ifndef NEOSH_BUILTIN
+int main(int argc, char *argv[]) {
+    return grep_main(argc, argv);
 }
+#endif
@@ -0,0 +1,683 @@
+/*  Author: Dishank Goel
+*   Date written: 21st August 2020
+*
+*   The job table of the shell, read more in jobs.h
+*/
+
+#define _GNU_SOURCE     // Declared for posix_spawn_file_actions_addtcsetpgrp_np
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <sys/signalfd.h>
+#include "util.h"
+#include "jobs.h"
+
+int job_control;
+static int signal_fd = -1;
+static pid_t shell_pgid;
+static struct termios shell_modes;
+
+static struct job **table;      // table[id - 1], NULL where there is no job
+static int table_size;
+static unsigned long last_order;
+
+static void interrupt_handler(int sig) {
+    command_interrupted = 1;       // read more in util.h
+}
+
+/*  jobs_init - blocks SIGCHLD so that it is only read from the signalfd, and when the shell is
+*   interactive on a terminal, puts it in its own process group in foreground. Like every job control shell,
+*   it ignores the signals which would stop it when it is not in foreground
+*   Ctrl-C and Ctrl-\ reach the shell only while it has the terminal, at the prompt or running a
+*   command of its own. SIGQUIT is ignored and SIGINT is caught, so that the prompt starts over
+*   and the command running in the shell stops (read more about command_interrupted in util.h)
+*   returns -1 if the signalfd could not be made, the children are then reaped before every prompt
+*/
+int jobs_init(int interactive) {
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &set, NULL);
+    signal_fd = signalfd(-1, &set, SFD_NONBLOCK | SFD_CLOEXEC);
+
+    job_control = interactive && isatty(STDIN_FILENO);
+    if(job_control) {
+        while(tcgetpgrp(STDIN_FILENO) != (shell_pgid = getpgrp())) {
+            kill(-shell_pgid, SIGTTIN);     // started in background, wait until it is brought to foreground
+        }
+        signal(SIGTSTP, SIG_IGN);
+        signal(SIGTTIN, SIG_IGN);
+        signal(SIGTTOU, SIG_IGN);
+        signal(SIGQUIT, SIG_IGN);
+        struct sigaction action;
+        action.sa_handler = interrupt_handler;
+        action.sa_flags = SA_RESTART;       // a command running in the shell stops at its next check, not at an EINTR
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGINT, &action, NULL);
+        if(setpgid(0, 0) == 0) {
+            shell_pgid = getpid();
+        }
+        tcsetpgrp(STDIN_FILENO, shell_pgid);
+        tcgetattr(STDIN_FILENO, &shell_modes);
+    }
+    return signal_fd == -1 ? -1 : 0;
+}
+
+int jobs_signal_fd() {
+    return signal_fd;
+}
+
+/*  jobs_interrupted - if Ctrl-C was typed since the last call
+*/
+int jobs_interrupted() {
+    int was = command_interrupted;
+    command_interrupted = 0;
+    return was;
+}
+
+static int job_state(struct job *job) {
+    if(job->running > 0) {
+        return JOB_RUNNING;
+    }
+    for(int i = 0; i < job->num_processes; i++) {
+        if(job->processes[i].state == JOB_STOPPED) {
+            return JOB_STOPPED;
+        }
+    }
+    return JOB_DONE;
+}
+
+/*  job_status - the exit status of the job is the one of its last process, like in sh
+*   a process killed or stopped by a signal has 128 + the signal
+*/
+static int job_status(struct job *job) {
+    if(job->num_processes == 0) {
+        return 0;
+    }
+    int status = job->processes[job->num_processes - 1].status;
+    if(WIFEXITED(status)) {
+        return WEXITSTATUS(status);
+    } else if(WIFSIGNALED(status)) {
+        return 128 + WTERMSIG(status);
+    } else if(WIFSTOPPED(status)) {
+        return 128 + WSTOPSIG(status);
+    }
+    return 0;
+}
+
+static void remove_job(struct job *job) {
+    table[job->id - 1] = NULL;
+    free(job->command);
+    free(job->processes);
+    free(job);
+}
+
+static void set_state(struct job *job, struct job_process *process, int state) {
+    job->running += (state == JOB_RUNNING) - (process->state == JOB_RUNNING);
+    process->state = state;
+}
+
+/*  update_process - records what waitpid said about a child
+*   the processes of a job are searched from the last one, the ones started last are the ones
+*   most likely still running, when a job like parallel starts many of them
+*/
+static void update_process(pid_t pid, int status) {
+    for(int i = 0; i < table_size; i++) {
+        struct job *job = table[i];
+        for(int j = job ? job->num_processes - 1 : -1; j >= 0; j--) {
+            struct job_process *process = &job->processes[j];
+            if(process->pid != pid) {
+                continue;
+            }
+            if(WIFCONTINUED(status)) {
+                set_state(job, process, JOB_RUNNING);
+                return;
+            }
+            process->status = status;
+            if(WIFSTOPPED(status)) {
+                set_state(job, process, JOB_STOPPED);
+                job->order = ++last_order;      // a stopped job becomes the current one
+            } else {
+                set_state(job, process, JOB_DONE);
+            }
+            return;
+        }
+    }
+}
+
+/*  jobs_reap - reaps every child which exited, stopped or continued, without blocking
+*   the SIGCHLD queued on the signalfd are read first, they only said there was something to reap
+*   and without any there is nothing new, so waitpid is not even called
+*/
+void jobs_reap() {
+    struct signalfd_siginfo info[16];
+    if(signal_fd != -1) {
+        int pending = 0;
+        while(read(signal_fd, info, sizeof(info)) > 0) {
+            pending = 1;
+        }
+        if(!pending) {
+            return;
+        }
+    }
+    pid_t pid;
+    int status;
+    while((pid = waitpid(-1, &status, WNOHANG | WUNTRACED | WCONTINUED)) > 0) {
+        update_process(pid, status);
+    }
+}
+
+static struct job *current_job() {
+    struct job *current = NULL;
+    for(int i = 0; i < table_size; i++) {
+        if(table[i] != NULL && (current == NULL || table[i]->order > current->order)) {
+            current = table[i];
+        }
+    }
+    return current;
+}
+
+static void print_job(struct job *job, struct job *current) {
+    char state[32];
+    switch(job_state(job)) {
+    case JOB_RUNNING: strcpy(state, "Running"); break;
+    case JOB_STOPPED: strcpy(state, "Stopped"); break;
+    default:
+        if(job_status(job) == 0) {
+            strcpy(state, "Done");
+        } else if(job_status(job) > 128) {
+            snprintf(state, sizeof(state), "%s", strsignal(job_status(job) - 128));
+        } else {
+            snprintf(state, sizeof(state), "Exit %d", job_status(job));
+        }
+    }
+    printf("[%d]%c  %-24s%s\n", job->id, job == current ? '+' : ' ', state, job->command);
+}
+
+/*  jobs_notify - tells which jobs in background are done since the last prompt, and forgets them
+*   like sh, only on a terminal, a script does not print them
+*/
+void jobs_notify() {
+    struct job *current = current_job();
+    for(int i = 0; i < table_size; i++) {
+        if(table[i] != NULL && !table[i]->foreground && job_state(table[i]) == JOB_DONE) {
+            if(job_control) {
+                print_job(table[i], current);
+            }
+            remove_job(table[i]);
+        }
+    }
+}
+
+/*  job_create - a job for the stages, with the lowest id after the jobs which are there
+*   its command is the stages written back as one line. Returns NULL if there is no memory
+*/
+struct job *job_create(struct command *stages, int num_stages, int foreground) {
+    int id = table_size;
+    while(id > 0 && table[id - 1] == NULL) {
+        id--;
+    }
+    id++;
+    if(id > table_size) {
+        int size = table_size ? table_size * 2 : 16;
+        struct job **grown = realloc(table, size * sizeof(struct job *));
+        if(grown == NULL) {
+            return NULL;
+        }
+        memset(grown + table_size, 0, (size - table_size) * sizeof(struct job *));
+        table = grown;
+        table_size = size;
+    }
+
+    size_t length = 1;
+    for(int i = 0; i < num_stages; i++) {
+        for(int j = 0; j < stages[i].argc; j++) {
+            length += strlen(stages[i].argv[j]) + 3;
+        }
+    }
+    struct job *job = malloc(sizeof(struct job));
+    char *command = malloc(length);
+    struct job_process *processes = malloc(num_stages * sizeof(struct job_process));
+    if(job == NULL || command == NULL || processes == NULL) {
+        free(job);
+        free(command);
+        free(processes);
+        return NULL;
+    }
+    char *end = command;
+    *end = '\0';
+    for(int i = 0; i < num_stages; i++) {
+        if(i > 0) {
+            end = stpcpy(end, " |");
+        }
+        for(int j = 0; j < stages[i].argc; j++) {
+            if(i > 0 || j > 0) {
+                end = stpcpy(end, " ");
+            }
+            end = stpcpy(end, stages[i].argv[j]);
+        }
+    }
+    job->id = id;
+    job->pgid = 0;
+    job->foreground = foreground;
+    job->order = ++last_order;
+    job->command = command;
+    job->num_processes = 0;
+    job->capacity = num_stages;
+    job->running = 0;
+    job->processes = processes;
+    table[id - 1] = job;
+    return job;
+}
+
+/*  check_group - once all the processes of a job were reaped, its process group is gone
+*   and the next process started in the job has to make a new one
+*/
+static void check_group(struct job *job) {
+    if(job->pgid != 0 && job->num_processes > 0 && job_state(job) == JOB_DONE) {
+        job->pgid = 0;
+    }
+}
+
+/*  job_spawn_attr - sets up a posix_spawn for a process of the job: the signals the shell blocks
+*   or ignores are back to normal, and on a terminal it joins the process group of the job
+*   the first process of a job in foreground takes the terminal itself, before it can read from it
+*/
+void job_spawn_attr(struct job *job, posix_spawnattr_t *attr, posix_spawn_file_actions_t *actions) {
+    check_group(job);
+    sigset_t set;
+    short flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+    sigemptyset(&set);
+    posix_spawnattr_setsigmask(attr, &set);
+    sigaddset(&set, SIGTSTP);
+    sigaddset(&set, SIGTTIN);
+    sigaddset(&set, SIGTTOU);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGQUIT);
+    posix_spawnattr_setsigdefault(attr, &set);
+    if(job_control) {
+        flags |= POSIX_SPAWN_SETPGROUP;
+        posix_spawnattr_setpgroup(attr, job->pgid);
+        if(job->foreground && job->pgid == 0) {
+            posix_spawn_file_actions_addtcsetpgrp_np(actions, STDIN_FILENO);
+        }
+    }
+    posix_spawnattr_setflags(attr, flags);
+}
+
+/*  job_child - the same as job_spawn_attr, for a child forked to run a command of the shell
+*/
+void job_child(struct job *job) {
+    check_group(job);
+    if(job_control) {
+        pid_t pgid = job->pgid ? job->pgid : getpid();
+        setpgid(0, pgid);
+        if(job->foreground && job->pgid == 0) {
+            tcsetpgrp(STDIN_FILENO, pgid);
+        }
+        signal(SIGTSTP, SIG_DFL);
+        signal(SIGTTIN, SIG_DFL);
+        signal(SIGTTOU, SIG_DFL);
+        signal(SIGINT, SIG_DFL);
+        signal(SIGQUIT, SIG_DFL);
+    }
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGCHLD);
+    sigprocmask(SIG_UNBLOCK, &set, NULL);
+    if(signal_fd != -1) {
+        close(signal_fd);
+        signal_fd = -1;
+    }
+    job_control = 0;        // the child is not in foreground, the terminal belongs to the shell
+}
+
+/*  job_add_process - adds a child to the job, the parent puts it in the process group too
+*   so that it is there whichever of them runs first
+*/
+void job_add_process(struct job *job, pid_t pid) {
+    check_group(job);
+    if(job->num_processes == job->capacity) {
+        int capacity = job->capacity ? job->capacity * 2 : 4;
+        struct job_process *processes = realloc(job->processes, capacity * sizeof(struct job_process));
+        if(processes == NULL) {
+            return;         // not in the job, jobs_reap still reaps it
+        }
+        job->processes = processes;
+        job->capacity = capacity;
+    }
+    if(job_control) {
+        setpgid(pid, job->pgid ? job->pgid : pid);
+        if(job->pgid == 0) {
+            job->pgid = pid;
+        }
+    }
+    job->processes[job->num_processes].pid = pid;
+    job->processes[job->num_processes].state = JOB_RUNNING;
+    job->processes[job->num_processes].status = 0;
+    job->num_processes++;
+    job->running++;
+}
+
+/*  wait_slots - blocks until less than max processes of the job are running, the other
+*   children which exit meanwhile are reaped too
+*/
+static void wait_slots(struct job *job, int max) {
+    while(job->running >= max) {
+        int status;
+        pid_t pid = waitpid(-1, &status, WUNTRACED);
+        if(pid > 0) {
+            update_process(pid, status);
+        } else if(errno != EINTR) {     // no children left, nothing will change anymore
+            for(int i = 0; i < job->num_processes; i++) {
+                set_state(job, &job->processes[i], JOB_DONE);
+            }
+        }
+    }
+}
+
+static void wait_running(struct job *job) {
+    wait_slots(job, 1);
+}
+
+/*  job_wait_slot - waits until less than max processes of the job are running, for a job
+*   which keeps starting new processes as the others exit
+*   returns -1 if the job was interrupted, some process was stopped or killed by Ctrl-C,
+*   and no more processes should be started
+*/
+int job_wait_slot(struct job *job, int max) {
+    wait_slots(job, max);
+    for(int i = job->num_processes - 1; i >= 0; i--) {
+        struct job_process *process = &job->processes[i];
+        if(process->state == JOB_STOPPED ||
+           (process->state == JOB_DONE && WIFSIGNALED(process->status) && WTERMSIG(process->status) == SIGINT)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*  job_failures - how many processes of the job exited with an error
+*/
+int job_failures(struct job *job) {
+    int failures = 0;
+    for(int i = 0; i < job->num_processes; i++) {
+        int status = job->processes[i].status;
+        if(job->processes[i].state == JOB_DONE && !(WIFEXITED(status) && WEXITSTATUS(status) == 0)) {
+            failures++;
+        }
+    }
+    return failures;
+}
+
+/*  job_wait - waits for a job in foreground until it is done or stopped, with the terminal given
+*   to it meanwhile. A job which is done is forgotten, a stopped one stays in background
+*   returns the exit status of the job
+*/
+int job_wait(struct job *job) {
+    if(job_control && job->pgid != 0) {
+        tcsetpgrp(STDIN_FILENO, job->pgid);
+    }
+    wait_running(job);
+    int state = job_state(job);
+    if(job_control) {
+        tcsetpgrp(STDIN_FILENO, shell_pgid);
+        if(state == JOB_STOPPED) {
+            tcgetattr(STDIN_FILENO, &job->modes);
+        }
+        tcsetattr(STDIN_FILENO, TCSADRAIN, &shell_modes);
+    }
+    int status = job_status(job);
+    if(state == JOB_STOPPED) {
+        job->foreground = 0;
+        printf("\n");
+        print_job(job, current_job());
+    } else {
+        remove_job(job);
+    }
+    return status;
+}
+
+/*  job_start - the job is started once all its processes were added, in foreground it is waited for
+*   and in background its id and its last process are printed, like the notices only with job control
+*   returns the exit status of the job, or -1 if no process was started
+*/
+int job_start(struct job *job) {
+    if(job->num_processes == 0) {
+        remove_job(job);
+        return -1;
+    }
+    if(job->foreground) {
+        return job_wait(job);
+    }
+    if(job_control) {
+        printf("[%d] %d\n", job->id, job->processes[job->num_processes - 1].pid);
+    }
+    return 0;
+}
+
+/*  find_job - the job named by %n, or by %+ and %% for the current one
+*/
+static struct job *find_job(char *spec, char *program) {
+    struct job *job = NULL;
+    if(spec == NULL || strcmp(spec, "%%") == 0 || strcmp(spec, "%+") == 0) {
+        job = current_job();
+    } else if(spec[0] == '%') {
+        char *end;
+        long id = strtol(spec + 1, &end, 10);
+        if(*end == '\0' && id > 0 && id <= table_size) {
+            job = table[id - 1];
+        }
+    }
+    if(job == NULL) {
+        fprintf(stderr, "%s: %s: no such job\n", program, spec ? spec : "current");
+    }
+    return job;
+}
+
+/*  continue_job - sends SIGCONT to the processes of the job which are stopped
+*/
+static void continue_job(struct job *job) {
+    if(job->pgid != 0) {
+        killpg(job->pgid, SIGCONT);
+    }
+    for(int i = 0; i < job->num_processes; i++) {
+        if(job->processes[i].state == JOB_STOPPED) {
+            if(job->pgid == 0) {
+                kill(job->processes[i].pid, SIGCONT);
+            }
+            set_state(job, &job->processes[i], JOB_RUNNING);
+        }
+    }
+}
+
+/*  jobs - the shell command listing the jobs, the ones which are done are forgotten after
+*   Usage: jobs
+*/
+int jobs_command(int argc, char *argv[]) {
+    jobs_reap();
+    struct job *current = current_job();
+    for(int i = 0; i < table_size; i++) {
+        if(table[i] != NULL) {
+            print_job(table[i], current);
+            if(job_state(table[i]) == JOB_DONE) {
+                remove_job(table[i]);
+            }
+        }
+    }
+    return 0;
+}
+
+/*  fg - the shell command continuing a job in foreground, the current one if none is given
+*   Usage: fg [%n]
+*/
+int fg_command(int argc, char *argv[]) {
+    struct job *job = find_job(argc > 1 ? argv[1] : NULL, "fg");
+    if(job == NULL) {
+        return 1;
+    }
+    printf("%s\n", job->command);
+    fflush(stdout);
+    if(job_control && job_state(job) == JOB_STOPPED) {
+        tcsetattr(STDIN_FILENO, TCSADRAIN, &job->modes);
+    }
+    job->foreground = 1;
+    job->order = ++last_order;
+    if(job_control && job->pgid != 0) {
+        tcsetpgrp(STDIN_FILENO, job->pgid);     // before it continues, so it can read the terminal
+    }
+    continue_job(job);
+    return job_wait(job);
+}
+
+/*  bg - the shell command continuing a stopped job in background
+*   Usage: bg [%n]
+*/
+int bg_command(int argc, char *argv[]) {
+    struct job *job = find_job(argc > 1 ? argv[1] : NULL, "bg");
+    if(job == NULL) {
+        return 1;
+    }
+    job->foreground = 0;
+    continue_job(job);
+    printf("[%d]+ %s &\n", job->id, job->command);
+    return 0;
+}
+
+/*  wait - the shell command waiting for jobs in background, for %n, for a process id,
+*   or for all the jobs which are running if none is given
+*   returns the exit status of the last one waited for
+*   Usage: wait [%n | PID]...
+*/
+int wait_command(int argc, char *argv[]) {
+    int status = 0;
+    if(argc == 1) {
+        for(int i = 0; i < table_size; i++) {
+            if(table[i] != NULL && job_state(table[i]) == JOB_RUNNING) {
+                wait_running(table[i]);
+            }
+        }
+        jobs_reap();
+        for(int i = 0; i < table_size; i++) {       // they were waited for, so they are not notified
+            if(table[i] != NULL && job_state(table[i]) == JOB_DONE) {
+                remove_job(table[i]);
+            }
+        }
+        return 0;
+    }
+    for(int i = 1; i < argc; i++) {
+        struct job *job = NULL;
+        if(argv[i][0] == '%') {
+            job = find_job(argv[i], "wait");
+        } else {
+            pid_t pid = atoi(argv[i]);
+            for(int j = 0; j < table_size && job == NULL; j++) {
+                for(int k = 0; table[j] != NULL && k < table[j]->num_processes; k++) {
+                    if(table[j]->processes[k].pid == pid) {
+                        job = table[j];
+                    }
+                }
+            }
+            if(job == NULL) {
+                fprintf(stderr, "wait: pid %s is not a child of this shell\n", argv[i]);
+            }
+        }
+        if(job == NULL) {
+            status = 127;
+            continue;
+        }
+        wait_running(job);
+        status = job_status(job);
+        if(job_state(job) == JOB_DONE) {
+            remove_job(job);
+        }
+    }
+    return status;
+}
+
+static const struct {
+    char *name;
+    int number;
+} signal_names[] = {
+    {"HUP", SIGHUP}, {"INT", SIGINT}, {"QUIT", SIGQUIT}, {"KILL", SIGKILL}, {"USR1", SIGUSR1},
+    {"USR2", SIGUSR2}, {"TERM", SIGTERM}, {"CONT", SIGCONT}, {"STOP", SIGSTOP}, {"TSTP", SIGTSTP}
+};
+#define NUM_SIGNAL_NAMES (sizeof(signal_names) / sizeof(signal_names[0]))
+
+/*  parse_signal - the number of a signal given like 9, KILL or SIGKILL, -1 if it is not one
+*/
+static int parse_signal(char *name) {
+    char *end;
+    long number = strtol(name, &end, 10);
+    if(*end == '\0' && end != name) {
+        return (number > 0 && number < NSIG) ? number : -1;
+    }
+    if(strncmp(name, "SIG", 3) == 0) {
+        name += 3;
+    }
+    for(int i = 0; i < NUM_SIGNAL_NAMES; i++) {
+        if(strcmp(signal_names[i].name, name) == 0) {
+            return signal_names[i].number;
+        }
+    }
+    return -1;
+}
+
+/*  kill - the shell command sending a signal (TERM if none is given) to jobs or processes
+*   a job gets it in all its processes
+*   Usage: kill [-SIGNAL] %n | PID...
+*/
+int kill_command(int argc, char *argv[]) {
+    int sig = SIGTERM, i = 1, status = 0;
+    if(argc > 1 && argv[1][0] == '-') {
+        if((sig = parse_signal(argv[1] + 1)) == -1) {
+            fprintf(stderr, "kill: %s: invalid signal specification\n", argv[1] + 1);
+            return 1;
+        }
+        i++;
+    }
+    if(i == argc) {
+        fprintf(stderr, "kill: usage: kill [-SIGNAL] %%n | PID...\n");
+        return 1;
+    }
+    for(; i < argc; i++) {
+        int result = 0;
+        if(argv[i][0] == '%') {
+            struct job *job = find_job(argv[i], "kill");
+            if(job == NULL) {
+                status = 1;
+                continue;
+            }
+            if(job->pgid != 0) {
+                result = killpg(job->pgid, sig);
+            } else {
+                for(int j = 0; j < job->num_processes; j++) {
+                    if(job->processes[j].state != JOB_DONE && kill(job->processes[j].pid, sig) == -1) {
+                        result = -1;
+                    }
+                }
+            }
+            if(result == 0 && job_state(job) == JOB_STOPPED && sig != SIGSTOP && sig != SIGTSTP) {
+                continue_job(job);      // a stopped job would not see the signal until it continues, like in bash
+            }
+        } else {
+            char *end;
+            long pid = strtol(argv[i], &end, 10);
+            if(*end != '\0' || end == argv[i]) {
+                fprintf(stderr, "kill: %s: arguments must be process or job IDs\n", argv[i]);
+                status = 1;
+                continue;
+            }
+            result = kill(pid, sig);
+        }
+        if(result == -1) {
+            fprintf(stderr, "kill: %s: %s\n", argv[i], strerror(errno));
+            status = 1;
+        }
+    }
+    return status;
+}
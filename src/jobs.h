@@ -0,0 +1,68 @@
+/*  Author: Dishank Goel
+*   Date written: 21st August 2020
+*
+*   The job table of the shell, every pipeline it starts (or a single command) is a job
+*   Children are reaped as soon as they exit: SIGCHLD is blocked and read from a signalfd, which
+*   the shell polls along with its input while it waits for a line, so no zombie is left behind
+*   even when thousands of jobs run in background
+*
+*   When the shell runs on a terminal, every job is a process group of its own, and the one in
+*   foreground gets the terminal, so that Ctrl-Z stops it and fg and bg can continue it
+*   The shell commands are jobs, wait, fg, bg and kill, with jobs named like %1
+*/
+
+#ifndef NEOSH_JOBS_H
+#define NEOSH_JOBS_H
+
+#include <sys/types.h>
+#include <termios.h>
+#include <spawn.h>
+#include "parse.h"
+
+#define JOB_RUNNING 0
+#define JOB_STOPPED 1
+#define JOB_DONE 2
+
+struct job_process {
+    pid_t pid;
+    int state;
+    int status;             // from waitpid, once it is done
+};
+
+struct job {
+    int id;                 // the n of %n
+    pid_t pgid;             // 0 until the first process starts, and without a terminal
+    int foreground;
+    unsigned long order;    // the job with the highest is the current one, %+
+    char *command;
+    struct termios modes;   // of the terminal, saved when the job was stopped
+    int num_processes;
+    int capacity;
+    int running;            // how many processes are running
+    struct job_process *processes;
+};
+
+extern int job_control;     // the shell runs on a terminal and controls it
+
+int jobs_init(int interactive);
+int jobs_signal_fd();
+int jobs_interrupted();
+void jobs_reap();
+void jobs_notify();
+
+struct job *job_create(struct command *stages, int num_stages, int foreground);
+void job_spawn_attr(struct job *job, posix_spawnattr_t *attr, posix_spawn_file_actions_t *actions);
+void job_child(struct job *job);
+void job_add_process(struct job *job, pid_t pid);
+int job_start(struct job *job);
+int job_wait(struct job *job);
+int job_wait_slot(struct job *job, int max);
+int job_failures(struct job *job);
+
+int jobs_command(int argc, char *argv[]);
+int wait_command(int argc, char *argv[]);
+int fg_command(int argc, char *argv[]);
+int bg_command(int argc, char *argv[]);
+int kill_command(int argc, char *argv[]);
+
+#endif
@@ -2,159 +2,707 @@
 *   Date written: 21st August 2020
 *   
 *   ls.c implements the shell command `ls` for listing contents of a directory.
-*   Currently, it takes no option to list contents in long list format like -a -l
-*   Usage: ./ls [DIRECTORY]...
+*   -l lists the contents in long list format, with the sizes in K, M, G... when -h is given
+*   -a lists the hidden files too
+*   -f lists the files in directory order, without sorting them, as they are read
+*   Usage: ./ls [-alhf] [DIRECTORY]...
 */
 
+#define _GNU_SOURCE     // Declared for statx and getdents64
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <dirent.h>
 #include <errno.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <stdint.h>
+#include <limits.h>
+#include <time.h>
+#include <pwd.h>
+#include <grp.h>
 #include "util.h"
+#include "outbuf.h"
+#include "arena.h"
+#include "builtins.h"
 
-int multiple_arg;       // Will be used to find if there are multiple directories in arguments
-struct winsize w;       // To get the size of terminal emulator calling the shell, so that output can be pretty
+static int multiple_arg;       // Will be used to find if there are multiple directories in arguments
+static int unsorted;           // -f, the files are printed in directory order while being read
+static int show_all;           // -a, hidden files are listed too
+static int long_format;        // -l, one file per line with its mode, links, owner, group, size and time
+static int human;              // -h, sizes of the long format in K, M, G...
+static time_t now;             // files changed in the last six months show the time instead of the year
+static struct outbuf out;      // everything is printed through it, in big writes
+static struct winsize w;       // To get the size of terminal emulator calling the shell, so that output can be pretty
 
+#define KIND_FILE 0
+#define KIND_DIR 1
+#define KIND_EXEC 2
+#define KIND_LINK 3
 
-/*  find_col_length - The size of column in which output will be stacked 
-*   takes the list of contents [namelist], and the number of files [n] as arguments
-*/
-int find_col_length(struct dirent **namelist, int n) {
-    int max_width_name = 0;         // The max length among all the files to be printed
-    int i = 2;                // Starting from i = 2 to skip '.' and '..'
-    while(i < n) {
-        char *name = namelist[i]->d_name;
-        if(name[0] != '.') {
-            if(max_width_name < strlen(namelist[i]->d_name)) {
-                max_width_name = strlen(namelist[i]->d_name);
+#define DENTS_BUFFER_SIZE (1 << 20)     // directories are read with getdents64 in blocks this big
+#define ARENA_CHUNK_SIZE (1 << 20)      // the names are copied into chunks this big
+#define INSERTION_SORT_MAX 32           // radix sort leaves buckets this small to insertion sort
+#define SIX_MONTHS (183 * 24 * 60 * 60)
+#define LONG_MASK (STATX_TYPE | STATX_MODE | STATX_NLINK | STATX_UID | STATX_GID | STATX_SIZE | STATX_MTIME | STATX_BLOCKS)
+
+/*  entry_stat - what the long format prints about a file, from a single statx
+*   user and group point into the id caches, so they are looked up once per id
+*/
+struct entry_stat {
+    mode_t mode;
+    unsigned int nlink;
+    char *user;
+    char *group;
+    uint64_t size;
+    uint64_t blocks;        // in 512 byte units
+    int64_t mtime;
+};
+
+/*  entry - what ls needs to print a file, found once while reading the directory
+*   the name points into the arena of names
+*/
+struct entry {
+    char *name;
+    unsigned int length;
+    int kind;       // KIND_FILE, KIND_DIR, KIND_EXEC or KIND_LINK, decides the color
+    struct entry_stat *stat;        // only for -l, it is in the arena too
+};
+
+/*  sort_insertion - sorts entries which are equal in their first depth bytes
+*/
+static void sort_insertion(struct entry *entries, size_t n, size_t depth) {
+    for(size_t i = 1; i < n; i++) {
+        struct entry e = entries[i];
+        size_t j = i;
+        while(j > 0 && strcmp(entries[j - 1].name + depth, e.name + depth) > 0) {
+            entries[j] = entries[j - 1];
+            j--;
+        }
+        entries[j] = e;
+    }
+}
+
+/*  sort_radix - MSD radix sort of the entries by the bytes of their names (same order as strcmp)
+*   the entries are equal in their first depth bytes, they are put in buckets by the next byte
+*   and every bucket is sorted on the byte after it. tmp has space for n entries
+*/
+static void sort_radix(struct entry *entries, struct entry *tmp, size_t n, size_t depth) {
+    if(n <= INSERTION_SORT_MAX) {
+        sort_insertion(entries, n, depth);
+        return;
+    }
+    size_t count[257] = {0};       // bucket 0 is for names ending here, which come first
+    for(size_t i = 0; i < n; i++) {
+        int c = (depth < entries[i].length) ? (unsigned char)entries[i].name[depth] + 1 : 0;
+        count[c]++;
+    }
+    size_t start[257];
+    size_t sum = 0;
+    for(int c = 0; c < 257; c++) {
+        start[c] = sum;
+        sum += count[c];
+    }
+    for(size_t i = 0; i < n; i++) {
+        int c = (depth < entries[i].length) ? (unsigned char)entries[i].name[depth] + 1 : 0;
+        tmp[start[c]++] = entries[i];
+    }
+    memcpy(entries, tmp, n * sizeof(struct entry));
+
+    size_t bucket = count[0];
+    for(int c = 1; c < 257; c++) {
+        if(count[c] > 1) {
+            sort_radix(entries + bucket, tmp, count[c], depth + 1);
+        }
+        bucket += count[c];
+    }
+}
+
+/*  classify - finds if the file is a directory, an executable or a normal file
+*   the type given by readdir (d_type) is enough for directories, only for the others
+*   we need one statx, relative to the directory fd and asking only for the mode
+*   symbolic links are followed, so a link to a directory is shown as a directory
+*   the kind only picks the color, so without a terminal there is no statx at all
+*/
+static int classify(int dir_fd, char *name, unsigned char type) {
+    if(type == DT_DIR) {
+        return KIND_DIR;
+    } else if(!out.tty) {
+        return KIND_FILE;
+    }
+    struct statx stx;
+    if(statx(dir_fd, name, AT_STATX_DONT_SYNC, STATX_TYPE | STATX_MODE, &stx) == -1) {
+        return KIND_FILE;
+    }
+    if(S_ISDIR(stx.stx_mode)) {
+        return KIND_DIR;
+    } else if(stx.stx_mode & S_IXUSR) {
+        return KIND_EXEC;
+    }
+    return KIND_FILE;
+}
+
+/*  id_cache - names of the user or group ids, an open addressing hash table
+*   the passwd and group databases (NSS) are asked only the first time an id is seen,
+*   which matters when all the files of a big directory have the same few owners
+*/
+struct id_name {
+    unsigned int id;
+    char *name;
+};
+
+struct id_cache {
+    struct id_name *slots;
+    size_t capacity;        // a power of two, it doubles when half full
+    size_t count;
+    int group;              // look the ids up in the group database instead of passwd
+};
+
+static struct id_cache user_cache = {NULL, 0, 0, 0};
+static struct id_cache group_cache = {NULL, 0, 0, 1};
+
+static size_t hash_id(unsigned int id) {
+    return id * 2654435761u;
+}
+
+/*  resolve_id - the name of the id from NSS, or the number itself if it has no name
+*/
+static char *resolve_id(unsigned int id, int group) {
+    char buffer[16384];
+    char *name = NULL;
+    if(group) {
+        struct group grp, *found;
+        if(getgrgid_r(id, &grp, buffer, sizeof(buffer), &found) == 0 && found != NULL) {
+            name = strdup(found->gr_name);
+        }
+    } else {
+        struct passwd pwd, *found;
+        if(getpwuid_r(id, &pwd, buffer, sizeof(buffer), &found) == 0 && found != NULL) {
+            name = strdup(found->pw_name);
+        }
+    }
+    if(name == NULL && asprintf(&name, "%u", id) == -1) {
+        return NULL;
+    }
+    return name;
+}
+
+static int grow_id_cache(struct id_cache *cache) {
+    size_t capacity = cache->capacity ? cache->capacity * 2 : 16;
+    struct id_name *slots = calloc(capacity, sizeof(struct id_name));
+    if(slots == NULL) {
+        return -1;
+    }
+    for(size_t i = 0; i < cache->capacity; i++) {
+        if(cache->slots[i].name != NULL) {
+            size_t j = hash_id(cache->slots[i].id) & (capacity - 1);
+            while(slots[j].name != NULL) {
+                j = (j + 1) & (capacity - 1);
             }
+            slots[j] = cache->slots[i];
         }
-        i++;
     }
-    return max_width_name + 3;          // An offset of 3 to make some space among the columns
+    free(cache->slots);
+    cache->slots = slots;
+    cache->capacity = capacity;
+    return 0;
+}
+
+/*  lookup_id - the name of the id, from the cache or resolved and put in it
+*   returns "?" if there is no memory for it
+*/
+static char *lookup_id(struct id_cache *cache, unsigned int id) {
+    if((cache->count + 1) * 2 > cache->capacity && grow_id_cache(cache) == -1) {
+        return "?";
+    }
+    size_t mask = cache->capacity - 1;
+    size_t i = hash_id(id) & mask;
+    while(cache->slots[i].name != NULL) {
+        if(cache->slots[i].id == id) {
+            return cache->slots[i].name;
+        }
+        i = (i + 1) & mask;
+    }
+    char *name = resolve_id(id, cache->group);
+    if(name == NULL) {
+        return "?";
+    }
+    cache->slots[i].id = id;
+    cache->slots[i].name = name;
+    cache->count++;
+    return name;
+}
+
+static void free_id_cache(struct id_cache *cache) {
+    for(size_t i = 0; i < cache->capacity; i++) {
+        free(cache->slots[i].name);
+    }
+    free(cache->slots);
+    cache->slots = NULL;
+    cache->capacity = cache->count = 0;
 }
 
-/*  print_space_repeatedly - printing spaces as much as I want for pretty formatting output
+/*  stat_entry - for -l, the single statx of the file, which also gives its color
+*   links are not followed, the long format shows the link itself and where it points
+*   returns -1 if the file could not be statted
 */
-int print_space_repeatedly(int count) {
-    for(int i = 0; i < count; i++) {
-        printf(" ");
+static int stat_entry(int dir_fd, char *name, struct entry_stat *stat, int *kind) {
+    struct statx stx;
+    if(statx(dir_fd, name, AT_SYMLINK_NOFOLLOW | AT_STATX_DONT_SYNC, LONG_MASK, &stx) == -1) {
+        return -1;
+    }
+    stat->mode = stx.stx_mode;
+    stat->nlink = stx.stx_nlink;
+    stat->user = lookup_id(&user_cache, stx.stx_uid);
+    stat->group = lookup_id(&group_cache, stx.stx_gid);
+    stat->size = stx.stx_size;
+    stat->blocks = stx.stx_blocks;
+    stat->mtime = stx.stx_mtime.tv_sec;
+    if(S_ISLNK(stx.stx_mode)) {
+        *kind = KIND_LINK;
+    } else if(S_ISDIR(stx.stx_mode)) {
+        *kind = KIND_DIR;
+    } else if(stx.stx_mode & S_IXUSR) {
+        *kind = KIND_EXEC;
+    } else {
+        *kind = KIND_FILE;
     }
     return 0;
 }
 
+/*  find_col_length - The size of column in which output will be stacked 
+*   takes the list of [entries], and the number of entries [n] as arguments
+*/
+static int find_col_length(struct entry *entries, int n) {
+    size_t max_width_name = 0;         // The max length among all the files to be printed
+    for(int i = 0; i < n; i++) {
+        if(max_width_name < entries[i].length) {
+            max_width_name = entries[i].length;
+        }
+    }
+    return max_width_name + 3;          // An offset of 3 to make some space among the columns
+}
+
+/*  print_error - prints an error on stderr, after everything printed before it
+*/
+static void print_error(char *message, char *path, int error) {
+    outbuf_flush(&out);
+    fprintf(stderr, "ls: %s '%s': %s\n", message, path, strerror(error));
+}
+
 /*  print_name - Depending on the type of file, prints corresponding coloured output for that file
 *   executables -> green
 *   directories -> blue
+*   symbolic links -> cyan (only with -l, otherwise they are followed)
 *   normal files -> white
 */
-int print_name(char *dir, char *name) {
-    char *full_path = make_path(dir, name);     // make_path is in util.h, it concatenates dir with name, returns dir/name
-    int is_dir = check_dir(full_path);          // check_dir is in util.h, it checks if file is directory, normal file, or doesn't exist
-    int is_exec = check_executable(full_path);  // check executable is similar to check_dir, execept it check the exec bit
-    
-    /* is_dir should be true not -1 if it is a directory, read more in util.h */
-    if(is_dir && is_dir != -1) {
-        print_color_string(name, BOLD_BLUE);    // print_color_string is in util.h
-    }else if(is_exec) {     
-        print_color_string(name, BOLD_GREEN);
+static int print_name(struct entry *e) {
+    if(e->kind == KIND_DIR) {
+        outbuf_color(&out, e->name, e->length, BOLD_BLUE);    // outbuf_color is in outbuf.h
+    }else if(e->kind == KIND_EXEC) {     
+        outbuf_color(&out, e->name, e->length, BOLD_GREEN);
+    } else if(e->kind == KIND_LINK) {
+        outbuf_color(&out, e->name, e->length, BOLD_CYAN);
     } else {
-        printf("%s", name);
+        outbuf_write(&out, e->name, e->length);
     }
-        
     return 0;
 }
+
 /*  print_contents - responsible for printing all the contents given by ls
-*   takes the directory path [directory], all the names of files [namelist], and number of files [n]
-*/
-int print_contents(char *directory ,struct dirent **namelist, int n) {
-    int i = 2;              // skipping '.' and '..'
-    int file_no = 1;        // track of file number being printed
-    int col_size = find_col_length(namelist, n);
-    while (i < n) {
-        char *name = namelist[i]->d_name;       // name of the file being printed
-        if(name[0] != '.') {                    // skip all hidden files or directories
-            /*  |           |          |   |
-            *   |           |          |   |
-            *   |           |          |   |
-            *   |           |          |   |
-            *   <--col_size->          <    > not print in this leftover space
-            */
-            int space_size = col_size - strlen(name);   // remaning column length to be filled out by spaces
-
-            // find number of columns to be printed, remove the leftover space, and divide by column size
-            int num_cols = (w.ws_col - (w.ws_col%col_size))/col_size;       
-            print_name(directory, name);            
-            print_space_repeatedly(space_size);
-            if((file_no) % (num_cols) == 0) {   // if the next file is being printed in the leftover space, then start from newline
-                printf("\n");
-            }
-            file_no++;
+*   takes all the [entries] to be printed, and number of entries [n]
+*/
+static int print_contents(struct entry *entries, int n) {
+    int col_size = find_col_length(entries, n);
+
+    // find number of columns to be printed, remove the leftover space, and divide by column size
+    int num_cols = (w.ws_col - (w.ws_col%col_size))/col_size;       
+    if(num_cols == 0) {     // a name wider than the terminal gets a line to itself
+        num_cols = 1;
+    }
+    for(int i = 0; i < n; i++) {
+        /*  |           |          |   |
+        *   |           |          |   |
+        *   |           |          |   |
+        *   |           |          |   |
+        *   <--col_size->          <    > not print in this leftover space
+        */
+        int space_size = col_size - entries[i].length;   // remaning column length to be filled out by spaces
+        print_name(&entries[i]);
+        outbuf_repeat(&out, ' ', space_size);
+        if((i + 1) % (num_cols) == 0) {   // if the next file is being printed in the leftover space, then start from newline
+            outbuf_putc(&out, '\n');
         }
-        free(namelist[i]);
-        i++;
     }
-    if (i > 2) {            // If there were any files that were printed, then come to newline after printing them
-        printf("\n");
+    if (n % num_cols != 0) {        // If the last line was not complete, then come to newline after printing it
+        outbuf_putc(&out, '\n');
     }
     if(multiple_arg){       // More directories are being printed, so newline for them
-        printf("\n");
+        outbuf_putc(&out, '\n');
     }
     
     return 0;
 }
 
+/*  format_mode - the permissions like -rwxr-xr-x, with the type of the file first
+*/
+static void format_mode(mode_t mode, char *text) {
+    text[0] = S_ISDIR(mode) ? 'd' : S_ISLNK(mode) ? 'l' : S_ISCHR(mode) ? 'c' : S_ISBLK(mode) ? 'b'
+           : S_ISFIFO(mode) ? 'p' : S_ISSOCK(mode) ? 's' : '-';
+    const char *rwx = "rwxrwxrwx";
+    for(int i = 0; i < 9; i++) {
+        text[i + 1] = (mode & (0400 >> i)) ? rwx[i] : '-';
+    }
+    if(mode & S_ISUID) {
+        text[3] = (mode & S_IXUSR) ? 's' : 'S';
+    }
+    if(mode & S_ISGID) {
+        text[6] = (mode & S_IXGRP) ? 's' : 'S';
+    }
+    if(mode & S_ISVTX) {
+        text[9] = (mode & S_IXOTH) ? 't' : 'T';
+    }
+    text[10] = '\0';
+}
+
+/*  format_size - the size in bytes, or with -h rounded up to one decimal in K, M, G... like 1.5K or 12M
+*/
+static void format_size(uint64_t size, char *text, size_t length) {
+    if(!human || size < 1024) {
+        snprintf(text, length, "%llu", (unsigned long long)size);
+        return;
+    }
+    const char *units = "KMGTPE";
+    int unit = 0;
+    uint64_t unit_size = 1024;
+    while(unit < 5 && size / unit_size >= 1024) {
+        unit_size *= 1024;
+        unit++;
+    }
+    uint64_t tenths = (size / unit_size) * 10 + ((size % unit_size) * 10 + unit_size - 1) / unit_size;
+    if(tenths < 100) {
+        snprintf(text, length, "%llu.%llu%c", (unsigned long long)tenths / 10, (unsigned long long)tenths % 10, units[unit]);
+        return;
+    }
+    uint64_t whole = size / unit_size + (size % unit_size != 0);
+    if(whole >= 1024 && unit < 5) {     // rounding up made it the next unit
+        snprintf(text, length, "1.0%c", units[unit + 1]);
+    } else {
+        snprintf(text, length, "%llu%c", (unsigned long long)whole, units[unit]);
+    }
+}
+
+/*  count_digits - the width of a number when printed
+*/
+static int count_digits(uint64_t number) {
+    int digits = 1;
+    while(number >= 10) {
+        number /= 10;
+        digits++;
+    }
+    return digits;
+}
+
+/*  print_long - the long format (-l) of the [entries], every field in a column as wide as its widest value
+*   dir_fd is where the names of symbolic links are read from
+*   [directory] is set when the entries are the contents of a directory, the blocks they use are printed first
+*/
+static int print_long(struct entry *entries, int n, int dir_fd, int directory) {
+    int nlink_width = 0, user_width = 0, group_width = 0, size_width = 0;
+    uint64_t blocks = 0;
+    char size[32];
+    for(int i = 0; i < n; i++) {
+        struct entry_stat *stat = entries[i].stat;
+        int width = count_digits(stat->nlink);
+        if(width > nlink_width) {
+            nlink_width = width;
+        }
+        width = strlen(stat->user);
+        if(width > user_width) {
+            user_width = width;
+        }
+        width = strlen(stat->group);
+        if(width > group_width) {
+            group_width = width;
+        }
+        format_size(stat->size, size, sizeof(size));
+        width = strlen(size);
+        if(width > size_width) {
+            size_width = width;
+        }
+        blocks += stat->blocks;
+    }
+    if(directory) {
+        format_size(human ? blocks * 512 : (blocks + 1) / 2, size, sizeof(size));
+        outbuf_printf(&out, "total %s\n", size);
+    }
+
+    for(int i = 0; i < n; i++) {
+        struct entry_stat *stat = entries[i].stat;
+        char mode[11], date[32];
+        format_mode(stat->mode, mode);
+        format_size(stat->size, size, sizeof(size));
+        time_t mtime = stat->mtime;
+        struct tm tm;
+        localtime_r(&mtime, &tm);
+        if(mtime > now - SIX_MONTHS && mtime <= now) {
+            strftime(date, sizeof(date), "%b %e %H:%M", &tm);
+        } else {
+            strftime(date, sizeof(date), "%b %e  %Y", &tm);
+        }
+        outbuf_printf(&out, "%s %*u %-*s %-*s %*s %s ", mode, nlink_width, stat->nlink, user_width, stat->user,
+               group_width, stat->group, size_width, size, date);
+        print_name(&entries[i]);
+        if(S_ISLNK(stat->mode)) {
+            char target[PATH_MAX];
+            ssize_t length = readlinkat(dir_fd, entries[i].name, target, sizeof(target) - 1);
+            if(length != -1) {
+                target[length] = '\0';
+                outbuf_printf(&out, " -> %s", target);
+            }
+        }
+        outbuf_putc(&out, '\n');
+    }
+    if(directory && multiple_arg) {
+        outbuf_putc(&out, '\n');
+    }
+    return 0;
+}
+
+/*  read_contents - reads the whole directory with getdents64 in big blocks
+*   the names are copied into the arena and the entries grow in one array
+*   with -l the stat of every entry goes into the arena too
+*   returns the number of entries, or -1 if the directory could not be read
+*/
+static int read_contents(int dir_fd, struct arena *arena, struct entry **entries) {
+    char *buffer = malloc(DENTS_BUFFER_SIZE);
+    size_t capacity = 1024, n = 0;
+    *entries = malloc(capacity * sizeof(struct entry));
+    if(buffer == NULL || *entries == NULL) {
+        free(buffer);
+        return -1;
+    }
+
+    ssize_t nread;
+    while(!command_interrupted && (nread = getdents64(dir_fd, buffer, DENTS_BUFFER_SIZE)) > 0) {
+        for(ssize_t pos = 0; pos < nread; ) {
+            struct dirent64 *d = (struct dirent64 *)(buffer + pos);
+            pos += d->d_reclen;
+            if(d->d_name[0] == '.' && !show_all) {       // skip all hidden files or directories
+                continue;
+            }
+            if(n == capacity) {
+                capacity *= 2;
+                struct entry *bigger = realloc(*entries, capacity * sizeof(struct entry));
+                if(bigger == NULL) {
+                    nread = -1;
+                    break;
+                }
+                *entries = bigger;
+            }
+            size_t length = strlen(d->d_name);
+            struct entry *e = &(*entries)[n];
+            e->name = arena_copy(arena, d->d_name, length);
+            if(e->name == NULL) {
+                nread = -1;
+                break;
+            }
+            e->length = length;
+            e->stat = NULL;
+            if(long_format) {
+                e->stat = arena_alloc(arena, sizeof(struct entry_stat), _Alignof(struct entry_stat));
+                if(e->stat == NULL) {
+                    nread = -1;
+                    break;
+                }
+                if(stat_entry(dir_fd, d->d_name, e->stat, &e->kind) == -1) {
+                    print_error("cannot access", d->d_name, errno);
+                    continue;       // it was removed while listing, leave it out
+                }
+            } else {
+                e->kind = classify(dir_fd, d->d_name, d->d_type);
+            }
+            n++;
+        }
+        if(nread == -1) {
+            break;
+        }
+    }
+    free(buffer);
+    return nread == -1 ? -1 : n;
+}
+
+/*  stream_contents - for -f, prints the names one per line as every block of getdents64
+*   is read, so the memory used does not grow with the size of the directory
+*/
+static int stream_contents(int dir_fd) {
+    char *buffer = malloc(DENTS_BUFFER_SIZE);
+    if(buffer == NULL) {
+        return -1;
+    }
+    ssize_t nread;
+    while(!command_interrupted && (nread = getdents64(dir_fd, buffer, DENTS_BUFFER_SIZE)) > 0) {
+        for(ssize_t pos = 0; pos < nread; ) {
+            struct dirent64 *d = (struct dirent64 *)(buffer + pos);
+            pos += d->d_reclen;
+            if(d->d_name[0] != '.' || show_all) {
+                struct entry e = {d->d_name, strlen(d->d_name), classify(dir_fd, d->d_name, d->d_type), NULL};
+                print_name(&e);
+                outbuf_putc(&out, '\n');
+            }
+        }
+    }
+    free(buffer);
+    if(multiple_arg) {
+        outbuf_putc(&out, '\n');
+    }
+    return nread == -1 ? -1 : 0;
+}
+
 /*  list_contents - accesses the filesystem to get the contents and handle the errors
 *   needs only the path from where contents are being listed
+*   the type of every file is found once while reading, hidden files are skipped unless -a
+*   the names are sorted by their bytes with a radix sort, unless -f
 */
-int list_contents(char *directory) {
+static int list_contents(char *directory) {
     
-    struct dirent **namelist;
-    int n;
     int result = check_dir(directory);
     if(result && result != -1){         // the given path is a directory, read more in util.h for output of check_dir
-        n = scandir(directory, &namelist, NULL, alphasort);     // scandir reads and sorts the file contents alphabetically 
-        if (n == -1) {
-            fprintf(stderr, "ls: cannot access '%s': %s\n", directory, strerror(errno));
+        int dir_fd = open(directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC);      // the files are looked up relative to it
+        if(dir_fd == -1) {
+            print_error("cannot access", directory, errno);
             return -1;
         }
         if(multiple_arg){           // if there are multiple directories, then print their name 
-            printf("%s:\n", directory);
+            outbuf_printf(&out, "%s:\n", directory);
+        }
+        if(unsorted && !long_format) {     // the long format needs all the entries for the widths
+            result = stream_contents(dir_fd);
+            close(dir_fd);
+            if(result == -1) {
+                print_error("cannot read", directory, errno);
+            }
+            return result;
+        }
+
+        struct arena arena = ARENA_INIT(ARENA_CHUNK_SIZE);
+        struct entry *entries;
+        int n = read_contents(dir_fd, &arena, &entries);
+        int error = errno;
+        struct entry *tmp = (n > 0 && !unsorted) ? malloc(n * sizeof(struct entry)) : NULL;
+        if(n == -1 || (n > 0 && !unsorted && tmp == NULL)) {
+            print_error("cannot read", directory, n == -1 ? error : ENOMEM);
+            close(dir_fd);
+            free(entries);
+            arena_free(&arena);
+            return -1;
+        }
+        if(!unsorted) {
+            sort_radix(entries, tmp, n, 0);
+            free(tmp);
+        }
+        if(long_format) {
+            print_long(entries, n, dir_fd, 1);
+        } else {
+            print_contents(entries, n);
         }
-        print_contents(directory, namelist, n);
-        free(namelist);
+
+        close(dir_fd);
+        free(entries);
+        arena_free(&arena);
         return 0;
 
     } else if(!result && result != -1) {      // the given path is a regular file
-        printf("%s\n", directory);
+        if(long_format) {
+            struct entry_stat stat;
+            struct entry e = {directory, strlen(directory), KIND_FILE, &stat};
+            if(stat_entry(AT_FDCWD, directory, &stat, &e.kind) == -1) {
+                print_error("cannot access", directory, errno);
+                return -1;
+            }
+            return print_long(&e, 1, AT_FDCWD, 0);
+        }
+        outbuf_printf(&out, "%s\n", directory);
         return 0;
 
     } else {        // the path does not exist
-        fprintf(stderr, "ls: cannot access '%s': %s\n", directory, strerror(errno));
+        print_error("cannot access", directory, errno);
         return -1;
     }
 }
 
 
-int main(int argc, char *argv[]) {
+static int print_usage() {
+    fprintf(stderr, "Usage: ls [-alhf] [DIRECTORY]...\n");
+    return EXIT_FAILURE;
+}
+
+int ls_main(int argc, char *argv[]) {
 
     multiple_arg = 0;
+    unsorted = 0;
+    show_all = 0;
+    long_format = 0;
+    human = 0;
+
+    /*  getopt is used to parse for flags (options) in command line tokens
+    *   optind = 0 makes getopt start over, since the shell calls ls_main many times
+    */
+    int opt;
+    optind = 0;
+    while ((opt = getopt(argc, argv, "falh")) != -1) {
+        switch (opt) {
+        case 'f': unsorted = 1; break;
+        case 'a': show_all = 1; break;
+        case 'l': long_format = 1; break;
+        case 'h': human = 1; break;
+        default:
+            return print_usage();
+        }
+    }
+
     /* ioctl is used to control devices, in this case, we are accessing pts (terminal session) to find the width of terminal */
-    ioctl(0, TIOCGWINSZ, &w);       
-    if(argc > 2){
+    if(ioctl(0, TIOCGWINSZ, &w) == -1 || w.ws_col == 0) {
+        w.ws_col = 80;      // not a terminal, fall back to the usual width
+    }
+    if(outbuf_init(&out, STDOUT_FILENO) == -1) {
+        fprintf(stderr, "ls: %s\n", strerror(ENOMEM));
+        return EXIT_FAILURE;
+    }
+    now = time(NULL);
+    int num_args = argc - optind;       // number of non option arguments
+    int any_error = 0;
+    if(num_args > 1){
         multiple_arg = 1;
-        for(int i = 1; i < argc; i++) {
-            list_contents(argv[i]);         // list all the contents specified
+        for(int i = optind; i < argc && !command_interrupted; i++) {
+            if(list_contents(argv[i]) == -1) {         // list all the contents specified
+                any_error = 1;
+            }
         }
-    } else if(argc == 2) {
-        list_contents(argv[1]);
+    } else if(num_args == 1) {
+        any_error = (list_contents(argv[optind]) == -1);
     } else {
-        list_contents(".");     // if no argument, list the current directory
+        any_error = (list_contents(".") == -1);     // if no argument, list the current directory
+    }
+    free_id_cache(&user_cache);     // the names could change before ls is run again in the shell
+    free_id_cache(&group_cache);
+    int status = any_error ? EXIT_FAILURE : EXIT_SUCCESS;
+    if(command_interrupted) {
+        status = INTERRUPTED_STATUS;
+    }
+    if(outbuf_flush(&out) == -1) {
+        fprintf(stderr, "ls: write error: %s\n", strerror(out.error));
+        status = EXIT_FAILURE;
     }
-    exit(EXIT_SUCCESS);
-}
\ No newline at end of file
+    outbuf_free(&out);
+    return status;
+}
+
+#ifndef NEOSH_BUILTIN
+int main(int argc, char *argv[]) {
+    return ls_main(argc, argv);
+}
+#endif
@@ -0,0 +1,135 @@
+/*  Author: Dishank Goel
+*   Date written: 21st August 2020
+*
+*   Substring search used by grep, read more in match.h
+*/
+
+#include <string.h>
+#include "match.h"
+
+#ifdef __x86_64__         // SSE2 is part of the x86-64 baseline, AVX2 is checked at runtime
+#include <immintrin.h>
+#define HAVE_X86_SIMD
+#endif
+
+/*  Patterns at least this long are searched with Boyer-Moore-Horspool,
+*   its average shift is then longer than a SIMD block
+*/
+#define BMH_MIN_LENGTH 32
+
+/*  find_empty - the empty pattern matches at the start of every text
+*/
+static const char *find_empty(const struct matcher *m, const char *text, size_t length) {
+    return text;
+}
+
+/*  find_byte - a pattern of one byte is searched with memchr
+*/
+static const char *find_byte(const struct matcher *m, const char *text, size_t length) {
+    return memchr(text, m->pattern[0], length);
+}
+
+/*  find_bmh - Boyer-Moore-Horspool search
+*   the byte under the end of the window decides how far the window can be shifted
+*/
+static const char *find_bmh(const struct matcher *m, const char *text, size_t length) {
+    size_t n = m->length;
+    unsigned char last = m->pattern[n - 1];
+    size_t i = 0;
+    while(i + n <= length) {
+        unsigned char c = text[i + n - 1];
+        if(c == last && memcmp(text + i, m->pattern, n - 1) == 0) {
+            return text + i;
+        }
+        i += m->skip[c];
+    }
+    return NULL;
+}
+
+#ifdef HAVE_X86_SIMD
+
+/*  find_sse2 - compares 16 windows at once on their first and last byte,
+*   only the windows where both match are compared fully with memcmp
+*   the leftover tail (less than a block) is searched by find_bmh
+*/
+static const char *find_sse2(const struct matcher *m, const char *text, size_t length) {
+    size_t n = m->length;
+    const __m128i first = _mm_set1_epi8(m->pattern[0]);
+    const __m128i last = _mm_set1_epi8(m->pattern[n - 1]);
+    size_t i = 0;
+    for(; i + n - 1 + 16 <= length; i += 16) {
+        __m128i block_first = _mm_loadu_si128((const __m128i *)(text + i));
+        __m128i block_last = _mm_loadu_si128((const __m128i *)(text + i + n - 1));
+        unsigned int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, block_first),
+                                                            _mm_cmpeq_epi8(last, block_last)));
+        while(mask) {
+            int bit = __builtin_ctz(mask);
+            if(memcmp(text + i + bit + 1, m->pattern + 1, n - 2) == 0) {
+                return text + i + bit;
+            }
+            mask &= mask - 1;       // clear the lowest candidate
+        }
+    }
+    return find_bmh(m, text + i, length - i);
+}
+
+/*  find_avx2 - same as find_sse2, with 32 windows at once
+*/
+__attribute__((target("avx2")))
+static const char *find_avx2(const struct matcher *m, const char *text, size_t length) {
+    size_t n = m->length;
+    const __m256i first = _mm256_set1_epi8(m->pattern[0]);
+    const __m256i last = _mm256_set1_epi8(m->pattern[n - 1]);
+    size_t i = 0;
+    for(; i + n - 1 + 32 <= length; i += 32) {
+        __m256i block_first = _mm256_loadu_si256((const __m256i *)(text + i));
+        __m256i block_last = _mm256_loadu_si256((const __m256i *)(text + i + n - 1));
+        unsigned int mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(first, block_first),
+                                                                   _mm256_cmpeq_epi8(last, block_last)));
+        while(mask) {
+            int bit = __builtin_ctz(mask);
+            if(memcmp(text + i + bit + 1, m->pattern + 1, n - 2) == 0) {
+                return text + i + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return find_sse2(m, text + i, length - i);
+}
+
+#endif
+
+/*  compile_matcher - prepares the skip table and picks the find function for the pattern
+*   this is done once per pattern, not for every line
+*/
+void compile_matcher(struct matcher *m, char *pattern) {
+    size_t n = strlen(pattern);
+    m->pattern = pattern;
+    m->length = n;
+
+    for(int c = 0; c < 256; c++) {
+        m->skip[c] = n;
+    }
+    for(size_t j = 0; j + 1 < n; j++) {
+        m->skip[(unsigned char)pattern[j]] = n - 1 - j;
+    }
+
+    if(n == 0) {
+        m->find = find_empty;
+    } else if(n == 1) {
+        m->find = find_byte;
+    } else if(n >= BMH_MIN_LENGTH) {
+        m->find = find_bmh;
+    } else {
+#ifdef HAVE_X86_SIMD
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("avx2")) {
+            m->find = find_avx2;
+        } else {
+            m->find = find_sse2;
+        }
+#else
+        m->find = find_bmh;
+#endif
+    }
+}
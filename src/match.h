@@ -0,0 +1,30 @@
+/*  Author: Dishank Goel
+*   Date written: 21st August 2020
+*
+*   Substring search used by grep
+*   A pattern is compiled once into a matcher, which picks the fastest search for it:
+*   memchr for a single byte, a SIMD filter on the first and last byte of the pattern,
+*   or Boyer-Moore-Horspool for long patterns and machines without SIMD
+*/
+
+#ifndef NEOSH_MATCH_H
+#define NEOSH_MATCH_H
+
+#include <stddef.h>
+
+struct matcher;
+
+/*  find function of a matcher, returns the first match in text[0..length) or NULL
+*/
+typedef const char *(*find_fn)(const struct matcher *m, const char *text, size_t length);
+
+struct matcher {
+    char *pattern;
+    size_t length;
+    size_t skip[256];       // Boyer-Moore-Horspool shift for the last byte of the window
+    find_fn find;
+};
+
+void compile_matcher(struct matcher *m, char *pattern);
+
+#endif
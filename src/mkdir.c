@@ -1,28 +1,34 @@
 /*  Author: Dishank Goel
 *   Date written: 21st August 2020
 *   
-*   mkdir.c implements the `mkdir` command in UNIX without any options
+*   mkdir.c implements the `mkdir` command in UNIX with -p option
 *   mkdir is used to create new directories if they don't exist
-*   Usage: ./mkdir DIRECTORY...
+*   -p creates the missing parents too, and it is not an error if the directory exists
+*   Usage: ./mkdir [-p] DIRECTORY...
 */
 
+#define _GNU_SOURCE     // Declared for O_PATH
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
 #include <errno.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include "builtins.h"
 
+static int make_parents;        // -p
 
-int print_usage() {
-    printf("Usage: mkdir DIRECTORY...\n");
+static int print_usage() {
+    printf("Usage: mkdir [-p] DIRECTORY...\n");
     printf("mkdir is a utility to create directory(ies), if they do not exist.\n");
     return 0;
 }
 
 /*  create_directory - simply calls mkdir over the directory, with default mode drwxr-xr-x
 */
-int create_directory(char *file) {
+static int create_directory(char *file) {
 
     int result = mkdir(file, 0755);
     if(result < 0) {
@@ -32,23 +38,121 @@ int create_directory(char *file) {
     return 0;
 }
 
-int main(int argc, char *argv[]) {
+/*  open_ancestor - finds the deepest directory of the path which exists, going up from the leaf
+*   every ancestor is tried with one open, the components after the one found start at *rest
+*   returns an fd of the ancestor to create the rest in, AT_FDCWD for the current directory, or -1
+*/
+static int open_ancestor(char *path, char **rest) {
+    size_t end = strlen(path);
+    while(1) {
+        while(end > 0 && path[end - 1] != '/') {        // go up one component
+            end--;
+        }
+        if(end == 0) {      // nothing of a relative path exists, start from the current directory
+            *rest = path;
+            return AT_FDCWD;
+        }
+        size_t cut = end;
+        while(cut > 1 && path[cut - 1] == '/') {      // dir//sub has dir as its parent
+            cut--;
+        }
+        char saved = path[cut];
+        path[cut] = '\0';
+        int fd = open(path, O_PATH | O_DIRECTORY | O_CLOEXEC);
+        path[cut] = saved;
+        if(fd != -1) {
+            *rest = path + end;
+            return fd;
+        } else if(errno != ENOENT) {
+            return -1;
+        }
+        end = cut - 1;
+    }
+}
+
+/*  create_parents - mkdir -p, the path is created with mkdirat component by component, starting
+*   from the deepest directory which exists, so only the missing components cost system calls
+*   if the directory already exists, it is not an error, even if it was created by someone else
+*   in the meantime
+*/
+static int create_parents(char *file) {
+    if(mkdir(file, 0755) == 0) {        // the parent exists, the usual case
+        return 0;
+    }
+    int error = errno;
+    struct stat statbuf;
+    if(error == EEXIST && stat(file, &statbuf) == 0 && S_ISDIR(statbuf.st_mode)) {
+        return 0;
+    } else if(error == ENOENT && file[0] != '\0') {
+        char *path = strdup(file);
+        char *rest;
+        int dir_fd = (path == NULL) ? -1 : open_ancestor(path, &rest);
+        error = (path == NULL) ? ENOMEM : errno;
+        char *name = (dir_fd == -1) ? NULL : strtok_r(rest, "/", &rest);
+        while(name != NULL) {
+            if(mkdirat(dir_fd, name, 0755) == -1 && errno != EEXIST) {      // EEXIST, made by someone else
+                error = errno;
+                break;
+            }
+            int fd = openat(dir_fd, name, O_PATH | O_DIRECTORY | O_CLOEXEC);
+            if(fd == -1) {
+                error = (errno == ENOTDIR) ? EEXIST : errno;     // a file is in the way
+                break;
+            }
+            if(dir_fd != AT_FDCWD) {
+                close(dir_fd);
+            }
+            dir_fd = fd;
+            name = strtok_r(NULL, "/", &rest);
+        }
+        if(dir_fd != -1 && dir_fd != AT_FDCWD) {
+            close(dir_fd);
+        }
+        free(path);
+        if(dir_fd != -1 && name == NULL) {
+            return 0;
+        }
+    }
+    fprintf(stderr, "mkdir: cannot create directory '%s': %s\n", file, strerror(error));
+    return -1;
+}
+
+int mkdir_main(int argc, char *argv[]) {
 
-    if(argc == 1) {
+    int opt;
+    make_parents = 0;
+    optind = 0;         // getopt starts over, since the shell calls mkdir_main many times
+    while ((opt = getopt(argc, argv, "p")) != -1) {
+        switch (opt) {
+        case 'p': make_parents = 1; break;
+        default:
+            print_usage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    if(optind == argc) {
         fprintf(stderr, "mkdir: missing operand\n");
         print_usage();
-        exit(EXIT_FAILURE);
+        return EXIT_FAILURE;
     } else {
         int result = 1;
-        for(int i = 1; i < argc; i++) {
-            if(create_directory(argv[i]) == -1) {
+        for(int i = optind; i < argc; i++) {
+            int n = make_parents ? create_parents(argv[i]) : create_directory(argv[i]);
+            if(n == -1) {
                 result = 0;     // if there was any error, exit with failure
             }
         }
         if(!result) {
-            exit(EXIT_FAILURE);
+            return EXIT_FAILURE;
         }
 
     }
-    exit(EXIT_SUCCESS);
+    return EXIT_SUCCESS;
+}
+
+#ifndef NEOSH_BUILTIN
+int main(int argc, char *argv[]) {
+    return mkdir_main(argc, argv);
 }
+#endif
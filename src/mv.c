@@ -1,74 +1,173 @@
 /*  Author: Dishank Goel
 *   Date written: 21st August 2020
-*   
-*   mv.c implements the `mv` command in UNIX without any options
+*
+*   mv.c implements the `mv` command in UNIX with -n option
 *   mv either renames the file to a new file, or moves a file or directory into another directory
-*   Usage: ./mv SOURCE DESTINATION
-*   or:    mv SOURCE(s) DIRECTORY
+*   across file systems, where rename does not work, the file is copied and then removed
+*   -n never overwrites an existing file
+*   Usage: ./mv [-n] SOURCE DESTINATION
+*   or:    mv [-n] SOURCE(s) DIRECTORY
 */
 
+#define _GNU_SOURCE     // Declared for renameat2
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <sys/stat.h>
 #include <sys/types.h>
-#include <dirent.h>
 #include <errno.h>
 #include <string.h>
 #include <fcntl.h>
 #include "util.h"
+#include "copy.h"
+#include "remove.h"
+#include "builtins.h"
+
+static int no_clobber;          // -n, existing files are left as they are
+
+/*  rename_file - renames old to new, with -n RENAME_NOREPLACE makes the kernel check that
+*   new does not exist in the same step as the rename, so nothing can be overwritten in between
+*   a file system without RENAME_NOREPLACE gets the check just before the rename
+*/
+static int rename_file(char *old, char *new) {
+    unsigned int flags = no_clobber ? RENAME_NOREPLACE : 0;
+    int result = renameat2(AT_FDCWD, old, AT_FDCWD, new, flags);
+    if(result == -1 && errno == EINVAL && flags) {
+        struct stat statbuf;
+        if(lstat(new, &statbuf) == 0) {
+            errno = EEXIST;
+            return -1;
+        }
+        result = rename(old, new);
+    }
+    return result;
+}
+
+/*  move_across - moves old to another file system, where it cannot be renamed
+*   it is copied inside the kernel with its mode, owner and times (read more in copy.h)
+*   and removed only when the whole copy worked. Directories are copied and removed by a pool of workers
+*   with -n the check that new does not exist is done before the copy, so it is not atomic here
+*   returns -1 and sets errno on failure, or -2 if the errors were already printed
+*/
+static int move_across(char *old, char *new) {
+    struct stat statbuf, new_stat;
+    if(lstat(old, &statbuf) == -1) {
+        return -1;
+    }
+    if(no_clobber && lstat(new, &new_stat) == 0) {
+        errno = EEXIST;
+        return -1;
+    }
+    int flags = COPY_MODE | COPY_METADATA;
+    if(S_ISDIR(statbuf.st_mode)) {
+        if(copy_tree(old, new, "mv", flags) != 0) {
+            fprintf(stderr, "mv: '%s' was not removed, its copy is not complete\n", old);
+            return -2;
+        }
+        return remove_tree(old, "mv") == -1 ? -2 : 0;
+    }
+    if(!S_ISREG(statbuf.st_mode) && !S_ISLNK(statbuf.st_mode)) {
+        errno = ENOTSUP;        // devices, fifos and sockets are not copied
+        return -1;
+    }
+
+    /*  like rename, a file which is not a directory is replaced by the new one */
+    if(lstat(new, &new_stat) == 0 && !S_ISDIR(new_stat.st_mode) && unlink(new) == -1) {
+        return -1;
+    }
+    int result = S_ISLNK(statbuf.st_mode) ? copy_link_at(AT_FDCWD, old, AT_FDCWD, new, flags)
+                                          : copy_file_at(AT_FDCWD, old, AT_FDCWD, new, flags);
+    if(result == -1) {
+        int error = errno;
+        if(S_ISREG(statbuf.st_mode)) {
+            unlink(new);        // do not leave half a file behind
+        }
+        errno = error;
+        return -1;
+    }
+    return unlink(old);
+}
 
 /* move - given an old file [old], and a new destination [new] (either new name or existing directory)
 *  either renames the old file to new name, or moves it into the directory
 *  n is check_dir status for the new file, check util.h for check_dir return status
 */
-int move(char *old, char *new, int n) {
-    int result;
+static int move(char *old, char *new, int n) {
+    char *new_path = new;
     if(n && n != -1) {  // New file is directory
-        char *new_path;
-        new_path = make_path(new, old);     // the new path will be inside the new folder with old name
-        result = rename(old, new_path);     // renames the old file to new path
-        if(result == 0) {
-            return 0;
-        } else {
-            fprintf(stderr, "mv: cannot move '%s' to '%s': %s\n", old, new_path, strerror(errno));
-            return -1;
-        }
-
-    }else {     // New path is not a directory, so it either a new name, or existing file
-        result = rename(old, new);      // overwrites the new file if it already exists 
-        if(result == 0) {
-            return 0;
-        } else {
-            fprintf(stderr, "mv: cannot move '%s' to '%s': %s\n", old, new, strerror(errno));
+        char *name = base_name(old);
+        new_path = (name == NULL) ? NULL : make_path(new, name);     // the new path will be inside the new folder with old name
+        free(name);
+        if(new_path == NULL) {
+            fprintf(stderr, "mv: cannot move '%s': %s\n", old, strerror(ENOMEM));
             return -1;
         }
     }
-    
+    int result = rename_file(old, new_path);        // overwrites the new file if it already exists, unless -n
+    if(result == -1 && errno == EXDEV) {        // the new path is on another file system
+        result = move_across(old, new_path);
+    }
+    if(result == -1 && errno == EEXIST && no_clobber) {
+        result = 0;     // -n skips the files which exist, like in UNIX mv
+    } else if(result == -1) {
+        fprintf(stderr, "mv: cannot move '%s' to '%s': %s\n", old, new_path, strerror(errno));
+    }
+    if(new_path != new) {
+        free(new_path);
+    }
+    return result == 0 ? 0 : -1;
+}
+
+static int print_usage() {
+    fprintf(stderr, "mv: missing operands\n");
+    printf("Usage: mv [-n] SOURCE DESTINATION\n");
+    printf("or:    mv [-n] SOURCE(s) DIRECTORY\n");
+    printf("A utility to Rename source to destination, or Move source(s) to directory\n");
+    return EXIT_FAILURE;
 }
 
+int mv_main(int argc, char *argv[]) {
 
-int main(int argc, char *argv[]) {
+    int opt;
+    no_clobber = 0;
+    optind = 0;         // getopt starts over, since the shell calls mv_main many times
+    while ((opt = getopt(argc, argv, "n")) != -1) {
+        switch (opt) {
+        case 'n': no_clobber = 1; break;
+        default:
+            return print_usage();
+        }
+    }
+    argc -= optind - 1;         // from here on, the operands are argv[1] to argv[argc - 1]
+    argv += optind - 1;
 
+    int any_error = 0;
     if(argc < 3) {
-        fprintf(stderr, "mv: missing operands\n");
-        printf("Usage: mv SOURCE DESTINATION\n");
-        printf("or:    mv SOURCE(s) DIRECTORY\n");
-        printf("A utility to Rename source to destination, or Move source(s) to directory\n");
-        exit(EXIT_FAILURE);
+        return print_usage();
     } else if(argc == 3) {          // if only ./mv OLD NEW is given, then NEW can be a file or directory
         int n = check_dir(argv[2]);
-        move(argv[1], argv[2], n);
+        any_error = move(argv[1], argv[2], n);
     } else {
-        int n = check_dir(argv[argc - 1]); 
-        if(n && n != -1) {          // if there are >2 arguments, then the last has to be a directory 
-            for(int i = 1; i < argc - 1; i++) {
-                move(argv[i], argv[argc - 1], n);
+        int n = check_dir(argv[argc - 1]);
+        if(n && n != -1) {          // if there are >2 arguments, then the last has to be a directory
+            for(int i = 1; i < argc - 1 && !command_interrupted; i++) {
+                if(move(argv[i], argv[argc - 1], n) == -1) {
+                    any_error = 1;
+                }
             }
         } else {
             fprintf(stderr, "mv: target '%s' is not a directory\n", argv[argc - 1]);
-            exit(EXIT_FAILURE);
+            return EXIT_FAILURE;
         }
     }
-    exit(EXIT_SUCCESS);
-}
\ No newline at end of file
+    if(command_interrupted) {
+        return INTERRUPTED_STATUS;
+    }
+    return any_error ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+#ifndef NEOSH_BUILTIN
+int main(int argc, char *argv[]) {
+    return mv_main(argc, argv);
+}
+#endif
@@ -20,14 +20,18 @@
 *       -> Chmod
 *       -> Mkdir
 *   3. Can run programs in background using & at the end
+*   4. Runs scripts without a prompt, with the commands separated by ;, && and ||
 *   
 *   To run shell, execute
 *   make; ./shell;
 *   inside the project directory 
+*   To run a script, execute ./shell script.nsh or ./shell -c 'commands'
 *
 */
 
+#define _GNU_SOURCE     // Declared for pipe2
 #include <stdio.h>
+#include <stdio_ext.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <sys/stat.h>
@@ -38,46 +42,83 @@
 #include <sys/wait.h>
 #include <fcntl.h>
 #include <pwd.h>
+#include <spawn.h>
+#include <poll.h>
+#include <limits.h>
 #include "util.h"
+#include "builtins.h"
+#include "parse.h"
+#include "jobs.h"
+#include "pool.h"
 
-#define MAX_COMMAND_LENGTH 49152
+#define READER_SIZE (1 << 16)   // the input is read in blocks this big
 #define MAX_SHELL_PATH 4096
-#define MAX_ARGVAL 4096
-#define MAX_ARGC 12
+#define LINE_ARENA_SIZE 16384   // the words of a line are parsed into it, it is reset for every line
+#define HASH_BUCKETS 64         // like bash, the commands of a session are few
+#define PARALLEL_BATCHES 4      // batches of parallel for every slot, a slot which frees early takes the next
 
 char *shell_path;       // Stores where the shell is installed, to find the inbuilt binaries
 char *prompt;           // Stores the current working dir relative to HOME for the prompt
 char *home_path;        // The path in HOME variable
 char *user_name;        // The username of the user calling the shell
 char *hostpc_name;      // The pc name of the user calling the shell
-char *self_implemented_binaries[] = {"ls", "grep", "cat", "mv", "cp", "pwd", "rm", "chmod", "mkdir"};
+
+/*  builtin - a self implemented command, and the entry point of its body linked into the shell
+*   these run inside the shell process instead of forking and executing bin/<name>
+*/
+struct builtin {
+    char *name;
+    int (*main)(int argc, char *argv[]);
+};
+
+struct builtin self_implemented_binaries[] = {
+    {"ls", ls_main}, {"grep", grep_main}, {"cat", cat_main},
+    {"mv", mv_main}, {"cp", cp_main}, {"pwd", pwd_main},
+    {"rm", rm_main}, {"chmod", chmod_main}, {"mkdir", mkdir_main}
+};
+#define NUM_SELF_IMPLEMENTED (sizeof(self_implemented_binaries) / sizeof(struct builtin))
+
+/*  hashed_command - where a command was found in PATH, so that PATH is searched only once for it
+*   the table is emptied when PATH changes, and an entry is dropped when its file is gone
+*/
+struct hashed_command {
+    char *name;
+    char *path;
+    int hits;
+    struct hashed_command *next;
+};
+
+struct hashed_command *command_hash[HASH_BUCKETS];
+char *hashed_path_env;      // the PATH the table was filled with
 
 int run_in_background;      // if the process has to be run in background
-int background_process_counter;     // how many programs have been run in backgound
+int last_status;            // exit status of the last pipeline, the shell exits with it
+
+/*  reader - reads the lines of the input in big blocks with read, without stdio
+*   a line can be as long as the memory allows, the buffer grows to hold it
+*/
+struct reader {
+    int fd;             // -1 once the end of the input was read
+    int from_stdin;     // the commands read the same stdin, past the lines of the shell
+    char *data;
+    size_t start;       // the next line starts here
+    size_t end;
+    size_t size;
+};
+struct reader *shell_input;     // the reader of run_shell
 
 
-/*  relative_path_from_home - converts a absolute path relative to the home path if 
-*   the path is in ~/, else gives back the absolute path
+/*  relative_path_from_home - writes the absolute path into relative_path, relative to the home path
+*   if the path is in ~/, else the absolute path as it is
 *   for example, /home/dishank/sem5 is changed to ~/sem5
 */
-char* relative_path_from_home(char *absolute_path) {
-    int path_len = strlen(absolute_path);
-    int home_len = strlen(home_path);
-    if(path_len < home_len) {       // if the path is shorter than home path
-        return absolute_path;
-    }else {
-        if(strncmp(absolute_path, home_path, home_len) == 0) {      // The absolute should start with the home path
-            
-            char *relative_path = malloc(MAX_SHELL_PATH*sizeof(char));
-            strcpy(relative_path, "~");     // Now the home path will be denoted by ~
-            if(home_len != path_len) {
-                strncat(relative_path, absolute_path + home_len, absolute_path - home_path);    // Append the rest of the absolute path
-            }
-            return relative_path;
-        }else {
-            return absolute_path;
-        }
-        
+void relative_path_from_home(char *absolute_path, char *relative_path) {
+    size_t home_len = strlen(home_path);
+    if(strncmp(absolute_path, home_path, home_len) == 0 &&
+       (absolute_path[home_len] == '/' || absolute_path[home_len] == '\0')) {      // The absolute should start with the home path
+        snprintf(relative_path, MAX_SHELL_PATH, "~%s", absolute_path + home_len);   // Now the home path will be denoted by ~
+    } else {
+        snprintf(relative_path, MAX_SHELL_PATH, "%s", absolute_path);
     }
 }
 
@@ -91,19 +132,21 @@ int cd(char *path) {
         return -1;
     
     } else {    
-        // update the prompt after changing the directory
-        char *buf = malloc(MAX_SHELL_PATH * sizeof(char));
-        prompt = getcwd(buf, MAX_SHELL_PATH);
-        prompt = relative_path_from_home(prompt);
+        // update the prompt after changing the directory, in the same buffer
+        char cwd[MAX_SHELL_PATH];
+        if(getcwd(cwd, MAX_SHELL_PATH) != NULL) {
+            relative_path_from_home(cwd, prompt);
+        }
     }
     return 0;
 }
 
-/*  exit_shell - A shell command for exiting the shell
-*   Usage: exit
+/*  exit_shell - A shell command for exiting the shell, with the status of the last command
+*   if none is given
+*   Usage: exit [STATUS]
 */
-int exit_shell() {
-    exit(EXIT_SUCCESS);
+int exit_shell(int status) {
+    exit(status);
 }
 
 /*  print_prompt - Prints the shell line that has username, pc name and the current working directory
@@ -129,103 +172,780 @@ int print_prompt(char *prompt) {
 
 /*  check_self_implemented - checks if the requested command has been implemented by me
 *   currently, the commands in self_implemented_binaries[] are self implemented 
+*   returns the builtin for the command, or NULL if it is not self implemented
 */
-int check_self_implemented(char *program) {
+struct builtin *check_self_implemented(char *program) {
     
-    for(int i = 0; i < 9; i++) {
+    for(int i = 0; i < NUM_SELF_IMPLEMENTED; i++) {
 
-        if(strcmp(self_implemented_binaries[i], program) == 0) {
-            return 1;
+        if(strcmp(self_implemented_binaries[i].name, program) == 0) {
+            return &self_implemented_binaries[i];
         }
     }
-    return 0;
+    return NULL;
+}
+
+int hash(int argc, char *argv[]);
+int type(int argc, char *argv[]);
+int parallel(int argc, char *argv[]);
+
+/*  shell_commands - the commands which need the state of the shell, like its hash table or its jobs
+*   in a pipeline they run in a child, with a copy of the state
+*/
+struct builtin shell_commands[] = {
+    {"hash", hash}, {"type", type}, {"jobs", jobs_command}, {"wait", wait_command},
+    {"fg", fg_command}, {"bg", bg_command}, {"kill", kill_command}, {"parallel", parallel}
+};
+#define NUM_SHELL_COMMANDS (sizeof(shell_commands) / sizeof(struct builtin))
+
+struct builtin *check_shell_command(char *program) {
+    for(int i = 0; i < NUM_SHELL_COMMANDS; i++) {
+        if(strcmp(shell_commands[i].name, program) == 0) {
+            return &shell_commands[i];
+        }
+    }
+    return NULL;
 }
 
-/*  parse_command - splits the input line using ' ' delimiter and creates the argv and argc
-*   for the new process
+/*  is_shell_command - checks if the command is run by the shell itself, and is not a program
 */
-int parse_command(char *line, char **command_argv, int *command_argc) {
+int is_shell_command(char *program) {
+    return strcmp(program, "exit") == 0 || strcmp(program, "cd") == 0 || check_shell_command(program) != NULL;
+}
 
-    char *val = malloc(MAX_ARGVAL*sizeof(char));    // will contain the separated token 
-    char *str1, *saveptr;
-    int j = 1;
+unsigned int hash_name(char *name) {
+    unsigned int hash = 2166136261u;        // FNV-1a
+    for(; *name; name++) {
+        hash = (hash ^ (unsigned char)*name) * 16777619u;
+    }
+    return hash % HASH_BUCKETS;
+}
 
-    // Specified in the man page of strtok
-    for(j = 1, str1 = line; j <= MAX_ARGC ; j++, str1 = NULL) {
-        val = strtok_r(str1, " ", &saveptr);
-        if(val == NULL) {
-            break;
+/*  hash_clear - forgets all the commands, like hash -r
+*/
+void hash_clear() {
+    for(int i = 0; i < HASH_BUCKETS; i++) {
+        while(command_hash[i] != NULL) {
+            struct hashed_command *next = command_hash[i]->next;
+            free(command_hash[i]->name);
+            free(command_hash[i]->path);
+            free(command_hash[i]);
+            command_hash[i] = next;
         }
-        command_argv[j - 1] = malloc(MAX_ARGVAL*sizeof(char));
-        strcpy(command_argv[j - 1], val);       // copy the token in command_argv in same order
     }
-    *command_argc = j - 1;      // the number of arguments
-    
-    /*  If the last argument is &, then don't count it
-    */
-    if(strcmp(command_argv[*command_argc - 1], "&") == 0) {
-        run_in_background = 1;
-        command_argv[*command_argc - 1] = NULL;
-        *command_argc = *command_argc - 1;
-    } else {
-        command_argv[*command_argc] = NULL;     //  execvp requires the ending of args by NULL 
+}
+
+/*  hash_remove - forgets one command, when its file was not there anymore
+*/
+void hash_remove(char *name) {
+    struct hashed_command **link = &command_hash[hash_name(name)];
+    while(*link != NULL) {
+        if(strcmp((*link)->name, name) == 0) {
+            struct hashed_command *entry = *link;
+            *link = entry->next;
+            free(entry->name);
+            free(entry->path);
+            free(entry);
+            return;
+        }
+        link = &(*link)->next;
+    }
+}
+
+/*  hash_find - the entry of the command, or NULL if it is not hashed
+*   the table is emptied first if PATH changed since it was filled
+*/
+struct hashed_command *hash_find(char *name) {
+    char *path_env = getenv("PATH");
+    if(path_env == NULL) {
+        path_env = "";
+    }
+    if(hashed_path_env == NULL || strcmp(hashed_path_env, path_env) != 0) {
+        hash_clear();
+        free(hashed_path_env);
+        hashed_path_env = strdup(path_env);
+    }
+    for(struct hashed_command *entry = command_hash[hash_name(name)]; entry != NULL; entry = entry->next) {
+        if(strcmp(entry->name, name) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/*  search_path - searches the directories of PATH for an executable file with the name
+*   returns its path (to be freed), or NULL if there is none
+*/
+char *search_path(char *name) {
+    char *path_env = getenv("PATH");
+    if(path_env == NULL) {
+        return NULL;
+    }
+    size_t name_len = strlen(name);
+    for(char *dir = path_env; ; ) {
+        size_t dir_len = strcspn(dir, ":");
+        char *path = malloc(dir_len + name_len + 2);
+        if(path == NULL) {
+            return NULL;
+        }
+        if(dir_len == 0) {      // an empty entry is the current directory
+            strcpy(path, name);
+        } else {
+            memcpy(path, dir, dir_len);
+            path[dir_len] = '/';
+            strcpy(path + dir_len + 1, name);
+        }
+        struct stat statbuf;
+        if(access(path, X_OK) == 0 && stat(path, &statbuf) == 0 && S_ISREG(statbuf.st_mode)) {
+            return path;
+        }
+        free(path);
+        if(dir[dir_len] == '\0') {
+            return NULL;
+        }
+        dir += dir_len + 1;
+    }
+}
+
+/*  find_command - the path to execute for a command, like execvp would find it
+*   a name with a '/' is a path already, other names are looked up in the hash table first
+*   and PATH is searched only if they are not there. Only absolute paths are hashed, the others
+*   depend on the current directory
+*   returns NULL if the command is not found, the path belongs to the table or to name
+*/
+char *find_command(char *name) {
+    if(strchr(name, '/') != NULL) {
+        return name;
+    }
+    struct hashed_command *entry = hash_find(name);
+    if(entry != NULL) {
+        entry->hits++;
+        return entry->path;
+    }
+    char *path = search_path(name);
+    if(path == NULL) {
+        return NULL;
+    }
+    entry = malloc(sizeof(struct hashed_command));
+    if(path[0] != '/' || entry == NULL || (entry->name = strdup(name)) == NULL) {
+        free(entry);
+        static char *unhashed;      // kept until the next unhashed command
+        free(unhashed);
+        unhashed = path;
+        return path;
+    }
+    entry->path = path;
+    entry->hits = 1;
+    unsigned int bucket = hash_name(name);
+    entry->next = command_hash[bucket];
+    command_hash[bucket] = entry;
+    return path;
+}
+
+/*  hash - the shell command showing the hashed commands, with -r they are forgotten
+*   and with names they are looked up and hashed
+*   Usage: hash [-r] [NAME]...
+*/
+int hash(int argc, char *argv[]) {
+    if(argc == 2 && strcmp(argv[1], "-r") == 0) {
+        hash_clear();
+        return 0;
+    }
+    int status = 0;
+    for(int i = 1; i < argc; i++) {
+        if(check_self_implemented(argv[i]) == NULL && find_command(argv[i]) == NULL) {
+            fprintf(stderr, "hash: %s: not found\n", argv[i]);
+            status = 1;
+        }
+    }
+    if(argc > 1) {
+        return status;
+    }
+    hash_find("");      // empties the table if PATH changed
+    int empty = 1;
+    for(int i = 0; i < HASH_BUCKETS; i++) {
+        for(struct hashed_command *entry = command_hash[i]; entry != NULL; entry = entry->next) {
+            if(empty) {
+                printf("hits\tcommand\n");
+                empty = 0;
+            }
+            printf("%4d\t%s\n", entry->hits, entry->path);
+        }
+    }
+    if(empty) {
+        printf("hash: hash table empty\n");
     }
-    
     return 0;
 }
 
-/*  exec_command - creates a new process by fork() and executes our given command using execvp
+/*  type - the shell command telling how every name would be run
+*   Usage: type NAME...
 */
-int exec_command(char *argv[], int argc) {
+int type(int argc, char *argv[]) {
+    int status = 0;
+    for(int i = 1; i < argc; i++) {
+        char *name = argv[i];
+        struct hashed_command *entry;
+        if(is_shell_command(name) || check_self_implemented(name) != NULL) {
+            printf("%s is a shell builtin\n", name);
+        } else if(strchr(name, '/') == NULL && (entry = hash_find(name)) != NULL) {
+            printf("%s is hashed (%s)\n", name, entry->path);
+        } else {
+            char *path = (strchr(name, '/') != NULL) ? (access(name, X_OK) == 0 ? name : NULL) : search_path(name);
+            if(path == NULL) {
+                fprintf(stderr, "neosh: type: %s: not found\n", name);
+                status = 1;
+                continue;
+            }
+            printf("%s is %s\n", name, path);
+            if(path != name) {
+                free(path);
+            }
+        }
+    }
+    return status;
+}
 
-    int child_pid = fork();
-    if(child_pid == -1) {       // there was a fork error
-        fprintf(stderr, "neosh: fork: %s\n", strerror(errno));
+/*  spawn_program - starts the program of the command with posix_spawn, the child shares the memory
+*   of the shell until it executes (like vfork) instead of copying its page tables like fork,
+*   so starting a program costs the same however big the shell grows
+*   its stdin, stdout and stderr are replaced by fds[0], fds[1] and fds[2] unless they are -1
+*   (or fds is NULL), the files are put in place by dup2 file actions of the spawn
+*   a hashed file which is not there anymore is dropped from the table and PATH is searched again
+*   the child is added to the job, returns its pid, or -1 after printing the error
+*/
+pid_t spawn_program(char *argv[], int fds[3], struct job *job) {
+
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    if((errno = posix_spawn_file_actions_init(&actions)) != 0) {
+        fprintf(stderr, "neosh: %s: %s\n", argv[0], strerror(errno));
         return -1;
     }
-    int wstatus, w;     // track the status of the child process in the parent process
-    if(child_pid == 0) {    // child process
-        execvp(argv[0], argv);
-        fprintf(stderr, "neosh: command not found: %s\n", argv[0]);     // if the child reaches here, then there was an error in execvp 
-        fflush(stderr);
-        kill(getpid(), SIGUSR1);        // kill the child process
+    if((errno = posix_spawnattr_init(&attr)) != 0) {
+        fprintf(stderr, "neosh: %s: %s\n", argv[0], strerror(errno));
+        posix_spawn_file_actions_destroy(&actions);
         return -1;
+    }
+    job_spawn_attr(job, &attr, &actions);
+    for(int fd = 0; fds != NULL && fd < 3; fd++) {
+        if(fds[fd] != -1) {
+            posix_spawn_file_actions_adddup2(&actions, fds[fd], fd);
+        }
+    }
 
-    } else {           // parent process
-        if(!run_in_background) {        // if the program is not being run in background, wait for child to finish
-            
-            //  WUNTRACED -> If a child has been stopped, return from it 
-            w = waitpid(child_pid, &wstatus, WUNTRACED);
-            if(w == -1) {
-                perror("waitpid");
+    pid_t child_pid;
+    int error = 0;
+    char *path = find_command(argv[0]);
+    if(path != NULL) {
+        error = posix_spawn(&child_pid, path, &actions, &attr, argv, environ);
+        if(error == ENOENT && path != argv[0]) {
+            hash_remove(argv[0]);
+            path = find_command(argv[0]);
+            if(path != NULL) {
+                error = posix_spawn(&child_pid, path, &actions, &attr, argv, environ);
             }
-        }else { // the process is being run in the background, so don't wait
-            printf("[%d] %d\n", background_process_counter, child_pid);
-            background_process_counter++;
         }
+    }
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+
+    if(path == NULL) {
+        fprintf(stderr, "neosh: command not found: %s\n", argv[0]);
+        return -1;
+    } else if(error != 0) {
+        fprintf(stderr, "neosh: %s: %s\n", argv[0], strerror(error));
+        return -1;
+    }
+    job_add_process(job, child_pid);
+    return child_pid;
+}
+
+/*  create_job - a job for the stages, in foreground unless the line ended with &
+*/
+struct job *create_job(struct command stages[], int num_stages) {
+    struct job *job = job_create(stages, num_stages, !run_in_background);
+    if(job == NULL) {
+        fprintf(stderr, "neosh: %s\n", strerror(ENOMEM));
+    }
+    return job;
+}
+
+/*  redirection - the fds a command gets as stdin, stdout and stderr, -1 to keep the ones of the shell
+*   owned tells the files opened for the command, which the shell closes once it started
+*/
+struct redirection {
+    int fds[3];
+    int owned[3];
+};
+
+void close_redirection(struct redirection *r) {
+    for(int fd = 0; fd < 3; fd++) {
+        if(r->owned[fd] && (fd != 2 || !r->owned[1] || r->fds[1] != r->fds[2])) {      // &> shares one file
+            close(r->fds[fd]);
+        }
+        r->owned[fd] = 0;
+    }
+}
+
+/*  open_redirection - opens the files of the redirections of the command, in the order they were
+*   written, over in and out which come from the pipes. When the same fd is redirected twice, every
+*   file is opened (and created) but the last one wins, like in sh
+*   the files are opened with O_CLOEXEC, only the dup2 onto 0, 1 and 2 reaches the program
+*   returns -1 after printing the error, nothing is left open then
+*/
+int open_redirection(struct command *command, int in, int out, struct redirection *r) {
+    r->fds[0] = in;
+    r->fds[1] = out;
+    r->fds[2] = -1;
+    r->owned[0] = r->owned[1] = r->owned[2] = 0;
+    for(int i = 0; i < command->num_redirects; i++) {
+        struct redirect *redirect = &command->redirects[i];
+        int flags = O_WRONLY | O_CREAT | O_TRUNC, first = 1, last = 1;
+        switch(redirect->type) {
+        case TOKEN_IN: flags = O_RDONLY; first = last = 0; break;
+        case TOKEN_APPEND: flags = O_WRONLY | O_CREAT | O_APPEND; break;
+        case TOKEN_ERR: first = last = 2; break;
+        case TOKEN_OUT_ERR: last = 2; break;
+        default: break;
+        }
+        int file = openat(AT_FDCWD, redirect->path, flags | O_CLOEXEC, 0666);
+        if(file == -1) {
+            fprintf(stderr, "neosh: %s: %s\n", redirect->path, strerror(errno));
+            close_redirection(r);
+            return -1;
+        }
+        for(int fd = first; fd <= last; fd++) {
+            int shared = (fd == 1 && r->owned[2] && r->fds[2] == r->fds[1]) || (fd == 2 && r->owned[1] && r->fds[1] == r->fds[2]);
+            if(r->owned[fd] && !shared) {
+                close(r->fds[fd]);
+            }
+            r->fds[fd] = file;
+            r->owned[fd] = 1;
+        }
+    }
+    return 0;
+}
+
+/*  redirect_shell - applies the redirections of a command which runs inside the shell process
+*   the fds of the shell are moved away and put back by restore_shell, in saved
+*   (-1 for the ones left as they are, -2 for the ones which were not open)
+*   returns -1 after printing the error, the command is not run then
+*/
+int redirect_shell(struct command *command, int saved[3]) {
+    struct redirection r;
+    saved[0] = saved[1] = saved[2] = -1;
+    if(command->num_redirects == 0) {
         return 0;
     }
+    if(open_redirection(command, -1, -1, &r) == -1) {
+        return -1;
+    }
+    fflush(stdout);
+    fflush(stderr);
+    for(int fd = 0; fd < 3; fd++) {
+        if(r.fds[fd] != -1) {
+            saved[fd] = fcntl(fd, F_DUPFD_CLOEXEC, 10);
+            if(saved[fd] == -1) {
+                saved[fd] = -2;
+            }
+            dup2(r.fds[fd], fd);
+        }
+    }
+    close_redirection(&r);
     return 0;
 }
 
-/*  take_line_input - takes the line input from user
-*   The newline at the end from fgets is stripped
+void restore_shell(int saved[3]) {
+    fflush(stdout);
+    fflush(stderr);
+    for(int fd = 0; fd < 3; fd++) {
+        if(saved[fd] >= 0) {
+            dup2(saved[fd], fd);
+            close(saved[fd]);
+        } else if(saved[fd] == -2) {
+            close(fd);
+        }
+    }
+}
+
+static int parallel_usage() {
+    fprintf(stderr, "Usage: parallel [-j N] [-n MAX] COMMAND [ARGS]... ::: ARGUMENT...\n");
+    return 1;
+}
+
+/*  parallel - the shell command running a command for many arguments, with at most N processes
+*   running at once (-j, the number of cores by default), the next one starts as soon as one exits
+*   the arguments are handed out in batches to start few processes, PARALLEL_BATCHES for every slot
+*   so that the slots whose batches finish first take on the rest instead of sitting idle behind
+*   a slow one, with at most MAX in a batch (-n) and never more than fit in ARG_MAX
+*   returns the number of processes which failed (at most 101, like GNU parallel), 127 if the command
+*   could not be started, or the status of the process which was interrupted
+*   Usage: parallel [-j N] [-n MAX] COMMAND [ARGS]... ::: ARGUMENT...
 */
-int take_line_input(char line[]) {
-    
+int parallel(int argc, char *argv[]) {
+
+    int slots = pool_default_workers(), max_args = 0, opt;
+    optind = 0;     // + stops at the command, its options are not for parallel
+    while((opt = getopt(argc, argv, "+j:n:")) != -1) {
+        switch(opt) {
+        case 'j': slots = atoi(optarg); break;
+        case 'n': max_args = atoi(optarg); break;
+        default:
+            return parallel_usage();
+        }
+    }
+    int separator = optind;
+    while(separator < argc && strcmp(argv[separator], ":::") != 0) {
+        separator++;
+    }
+    if(slots < 1 || max_args < 0 || separator == optind || separator == argc) {
+        return parallel_usage();
+    }
+    char **command = argv + optind;
+    int command_argc = separator - optind;
+    char **args = argv + separator + 1;
+    int num_args = argc - separator - 1;
+    if(num_args == 0) {
+        return 0;
+    }
+
+    // ARG_MAX holds the environment and the command too, with some room left like xargs does
+    long limit = sysconf(_SC_ARG_MAX);
+    limit = (limit > 0 ? limit : _POSIX_ARG_MAX) - 2048;
+    for(char **env = environ; *env != NULL; env++) {
+        limit -= strlen(*env) + 1 + sizeof(char *);
+    }
+    for(int i = 0; i < command_argc; i++) {
+        limit -= strlen(command[i]) + 1 + sizeof(char *);
+    }
+    long num_batches = (long)slots * PARALLEL_BATCHES;
+    int per_batch = (num_args + num_batches - 1) / num_batches;
+    if(max_args > 0 && max_args < per_batch) {
+        per_batch = max_args;
+    }
+
+    struct command whole = {argv, argc};
+    char **batch = malloc((command_argc + per_batch + 1) * sizeof(char *));
+    struct job *job = (batch == NULL) ? NULL : job_create(&whole, 1, 1);
+    if(job == NULL) {
+        fprintf(stderr, "parallel: %s\n", strerror(ENOMEM));
+        free(batch);
+        return 1;
+    }
+    memcpy(batch, command, command_argc * sizeof(char *));
+    int interrupted = 0, failed = 0;
     fflush(stdout);
-    if(fgets(line, MAX_COMMAND_LENGTH, stdin)) {
-        line[strcspn(line, "\r\n")] = 0;    // strip the newline at the end
+    for(int next = 0; next < num_args; ) {
+        if(job_wait_slot(job, slots) == -1) {       // Ctrl-C or Ctrl-Z, the rest is not started
+            interrupted = 1;
+            break;
+        }
+        int count = 0;
+        long size = 0;
+        while(next < num_args && count < per_batch) {
+            long cost = strlen(args[next]) + 1 + sizeof(char *);
+            if(count > 0 && size + cost > limit) {
+                break;
+            }
+            size += cost;
+            batch[command_argc + count++] = args[next++];
+        }
+        batch[command_argc + count] = NULL;
+        if(spawn_program(batch, NULL, job) == -1) {      // the next batches would fail the same way
+            failed = 1;
+            break;
+        }
+    }
+    free(batch);
+
+    if(job->num_processes == 0) {
+        job_start(job);         // nothing was started, the job is dropped
+        return 127;
+    }
+    job_wait_slot(job, 1);
+    int failures = job_failures(job);
+    int status = job_wait(job);
+    if(interrupted) {
+        return status;
+    } else if(failed) {
+        return 127;
+    }
+    return failures > 101 ? 101 : failures;
+}
+
+/*  give_back_input - when the shell reads its lines from stdin, the commands it runs read the
+*   same stdin, and the reader has already taken the lines after the current one. If stdin can
+*   seek (a script given with <), the reader seeks back to the end of the current line and drops
+*   the rest, like sh does, so the command starts reading right after its own line
+*   returns the number of bytes still held by the reader, which a pipe cannot be given back
+*/
+size_t give_back_input() {
+    struct reader *reader = shell_input;
+    if(reader == NULL || !reader->from_stdin || reader->start == reader->end) {
         return 0;
-    }else {
+    }
+    if(lseek(STDIN_FILENO, -(off_t)(reader->end - reader->start), SEEK_CUR) != -1) {
+        reader->start = reader->end = 0;
+        reader->fd = STDIN_FILENO;      // the end of the input is not reached anymore
+        return 0;
+    }
+    return reader->end - reader->start;
+}
+
+/*  read_held_input - the read function of the stdio stream from input_stream, it gives out the
+*   bytes held by the reader first, then reads stdin
+*/
+static ssize_t read_held_input(void *cookie, char *buffer, size_t size) {
+    struct reader *reader = cookie;
+    if(reader->start < reader->end) {
+        size_t n = reader->end - reader->start;
+        n = (n < size) ? n : size;
+        memcpy(buffer, reader->data + reader->start, n);
+        reader->start += n;
+        return n;
+    }
+    ssize_t n;
+    while((n = read(STDIN_FILENO, buffer, size)) == -1 && errno == EINTR);
+    return n;
+}
+
+/*  input_stream - a stdio stream for a command of the shell whose stdin is the input of the shell,
+*   which reads the lines held by the reader before stdin, so they are not lost to the command
+*   returns NULL if stdin can be read as it is
+*/
+FILE *input_stream() {
+    if(give_back_input() == 0) {
+        return NULL;
+    }
+    cookie_io_functions_t functions = {read_held_input, NULL, NULL, NULL};
+    return fopencookie(shell_input, "r", functions);
+}
+
+/*  exec_builtin - runs a command inside the shell process, no fork() and exec
+*   its redirections are applied to the fds of the shell while it runs, so writing to a file
+*   does not need a child either. Read more in exec_pipeline for when a child is needed
+*/
+int exec_builtin(struct builtin *builtin, struct command *command) {
+
+    int saved[3];
+    if(redirect_shell(command, saved) == -1) {
+        return 1;
+    }
+    FILE *shell_stdin = stdin, *input = input_stream();     // never with <, it runs in a child
+    if(input != NULL) {
+        stdin = input;
+    }
+    int status = builtin->main(command->argc, command->argv);
+    if(input != NULL) {
+        stdin = shell_stdin;
+        fclose(input);
+    }
+    fflush(stdout);
+    fflush(stderr);
+    restore_shell(saved);
+    return status;
+}
+
+/*  exec_pipeline - runs the stages of a pipeline concurrently, connecting the stdout of every
+*   stage to the stdin of the next one with a pipe, the redirections of a stage come after its pipes
+*   programs are spawned, the self implemented commands are called in a forked child without exec
+*   the pipes are created with O_CLOEXEC, so that the executed programs only see their stdin and stdout
+*   a single command runs here too when it needs a child: a program, a command in background,
+*   or a builtin reading a file, since the stdin of the shell is buffered by stdio
+*   a stage reading the stdin the shell reads its lines from gets the lines read ahead, read more
+*   in give_back_input. A program cannot get them from a pipe, only from a file it can seek
+*   returns the exit status of the last stage, 0 in background
+*/
+int exec_pipeline(struct command stages[], int num_stages) {
+
+    int prev_read = -1;         // read end of the pipe coming from the previous stage
+    int i, last_failed = 0;
+    struct job *job = create_job(stages, num_stages);
+    if(job == NULL) {
         return -1;
     }
+
+    fflush(stdout);     // so that the children do not inherit (and print again) the unflushed output
+    give_back_input();  // a program reading stdin starts after the line, when stdin can seek
+    for(i = 0; i < num_stages; i++) {
+        char **argv = stages[i].argv;
+        int pipefd[2] = {-1, -1};
+        if(i < num_stages - 1 && pipe2(pipefd, O_CLOEXEC) == -1) {
+            fprintf(stderr, "neosh: pipe: %s\n", strerror(errno));
+            break;
+        }
+
+        int child_pid;
+        struct redirection r;
+        FILE *input;
+        struct builtin *builtin = check_self_implemented(argv[0]);
+        if(builtin == NULL) {
+            builtin = check_shell_command(argv[0]);
+        }
+        if(open_redirection(&stages[i], prev_read, pipefd[1], &r) == -1) {
+            child_pid = -1;     // like a program which cannot be started, the other stages still run
+        } else if(builtin == NULL && !is_shell_command(argv[0])) {
+            /*  a program is spawned with the pipes as stdin and stdout, O_CLOEXEC closes the rest
+            *   if it cannot be started, the other stages still run and read or write nothing from it
+            */
+            child_pid = spawn_program(argv, r.fds, job);
+        } else if((child_pid = fork()) == -1) {
+            fprintf(stderr, "neosh: fork: %s\n", strerror(errno));
+            close_redirection(&r);
+            close(pipefd[0]);
+            close(pipefd[1]);
+            break;
+        } else if(child_pid == 0) {    // child process running a command of the shell
+            job_child(job);
+            for(int fd = 0; fd < 3; fd++) {
+                if(r.fds[fd] != -1) {
+                    dup2(r.fds[fd], fd);
+                }
+            }
+            if(r.fds[0] != -1) {
+                __fpurge(stdin);        // drop the input the shell had buffered, stdin is the pipe or file now
+            } else if((input = input_stream()) != NULL) {
+                stdin = input;          // the lines the shell has read ahead come first
+            }
+            for(int fd = 0; fd < 2; fd++) {
+                if(pipefd[fd] != -1) {
+                    close(pipefd[fd]);      // builtins never exec, so O_CLOEXEC does not close these
+                }
+            }
+            if(prev_read != -1) {
+                close(prev_read);
+            }
+            if(builtin != NULL) {
+                exit(builtin->main(stages[i].argc, argv));
+            }
+            fprintf(stderr, "neosh: %s: cannot be used in a pipeline\n", argv[0]);
+            exit(EXIT_FAILURE);
+        } else {
+            job_add_process(job, child_pid);
+            if(r.fds[0] == -1 && shell_input != NULL && shell_input->from_stdin) {
+                shell_input->start = shell_input->end;      // the lines read ahead went to the child
+            }
+        }
+        close_redirection(&r);      // the child has them now
+
+        last_failed = (child_pid == -1);
+        if(prev_read != -1) {
+            close(prev_read);
+        }
+        close(pipefd[1]);
+        prev_read = pipefd[0];
+    }
+    if(prev_read != -1) {       // the pipeline broke in the middle
+        close(prev_read);
+    }
+
+    int status = job_start(job);
+    return last_failed ? 127 : status;
+}
+
+/*  wait_for_input - polls the input along with the signalfd of the jobs, so that the children
+*   which exit while the shell waits for a line are reaped right away, not at the next command
+*   returns -1 if it was interrupted by Ctrl-C, 0 otherwise
+*/
+int wait_for_input(int fd) {
+    struct pollfd fds[2] = {{fd, POLLIN, 0}, {jobs_signal_fd(), POLLIN, 0}};
+    if(fds[1].fd == -1) {
+        return 0;
+    }
+    while(1) {
+        fds[0].revents = fds[1].revents = 0;
+        if(poll(fds, 2, -1) == -1) {
+            return errno == EINTR ? -1 : 0;
+        }
+        if(fds[1].revents & POLLIN) {
+            jobs_reap();
+        }
+        if(fds[0].revents) {        // input, end of file or an error, read finds out which
+            return 0;
+        }
+    }
+}
+
+int reader_init(struct reader *reader, int fd) {
+    reader->fd = fd;
+    reader->from_stdin = (fd == STDIN_FILENO);
+    reader->data = malloc(READER_SIZE);
+    reader->start = reader->end = 0;
+    reader->size = READER_SIZE;
+    return reader->data == NULL ? -1 : 0;
+}
+
+/*  reader_string - a reader giving the lines of the string, for -c
+*/
+int reader_string(struct reader *reader, char *string) {
+    reader->fd = -1;
+    reader->from_stdin = 0;
+    reader->data = strdup(string);
+    reader->start = 0;
+    reader->end = strlen(string);
+    reader->size = reader->end + 1;
+    return reader->data == NULL ? -1 : 0;
+}
+
+/*  read_line - the next line of the input without its newline, or NULL at the end of the input
+*   the line is in the buffer of the reader, and is valid until the next call
+*/
+char *read_line(struct reader *reader) {
+    while(1) {
+        char *line = reader->data + reader->start;
+        char *newline = memchr(line, '\n', reader->end - reader->start);
+        if(newline != NULL) {
+            *newline = '\0';
+            reader->start = newline + 1 - reader->data;
+            return line;
+        }
+        if(reader->fd == -1) {
+            if(reader->start == reader->end) {
+                return NULL;
+            }
+            reader->data[reader->end] = '\0';      // the last line has no newline, there is always a byte left for this
+            reader->start = reader->end;
+            return line;
+        }
+
+        // the start of the line goes to the front of the buffer, which grows if the line fills it
+        memmove(reader->data, line, reader->end - reader->start);
+        reader->end -= reader->start;
+        reader->start = 0;
+        if(reader->size - reader->end < 2) {
+            char *data = realloc(reader->data, reader->size * 2);
+            if(data == NULL) {
+                fprintf(stderr, "neosh: %s\n", strerror(ENOMEM));
+                return NULL;
+            }
+            reader->data = data;
+            reader->size *= 2;
+        }
+        if(wait_for_input(reader->fd) == -1) {
+            reader->end = 0;            // Ctrl-C drops the line being typed, like the terminal does
+            reader->data[0] = '\0';
+            return reader->data;
+        }
+        ssize_t n = read(reader->fd, reader->data + reader->end, reader->size - reader->end - 1);
+        if(n == -1 && errno == EINTR) {
+            continue;
+        } else if(n == -1) {
+            fprintf(stderr, "neosh: read error: %s\n", strerror(errno));
+        }
+        if(n <= 0) {
+            reader->fd = -1;
+        } else {
+            reader->end += n;
+        }
+    }
 }
 
 /*  initialize_shell - is called when the shell starts
 *   sets up the shell path, usernames, host names, and current working directory
+*   job control is only for an interactive shell, not for scripts
 */
-int initialize_shell() {
+int initialize_shell(int interactive) {
 
     shell_path = malloc(MAX_SHELL_PATH * sizeof(char));
     prompt = malloc(MAX_SHELL_PATH * sizeof(char));
@@ -233,7 +953,7 @@ int initialize_shell() {
     user_name = malloc(1024 * sizeof(char));
     hostpc_name = malloc(1024 * sizeof(char));
 
-    background_process_counter = 1;
+    jobs_init(interactive);
 
     //  If something went wrong and path could not be set, then exit
     if(shell_path == NULL || prompt == NULL) {
@@ -264,71 +984,157 @@ int initialize_shell() {
         exit(EXIT_FAILURE);
 
     }else {
-        strcpy(prompt, shell_path);     // intially, the prompt is the shell path
-        prompt = relative_path_from_home(prompt);   // update it relative to the home
+        relative_path_from_home(shell_path, prompt);    // intially, the prompt is the shell path, relative to the home
         return 0;
     }
 
 }
 
+/*  run_pipeline - runs a pipeline of the line, the self implemented commands and the commands
+*   of the shell run inside the shell process when they can
+*   returns its exit status
+*/
+int run_pipeline(struct pipeline *pipeline) {
+
+    run_in_background = pipeline->background;
+    struct command *command = &pipeline->stages[0];
+    struct builtin *builtin = NULL;
+    if(command->argc > 0 && (builtin = check_self_implemented(command->argv[0])) == NULL) {
+        builtin = check_shell_command(command->argv[0]);
+    }
+    int reads_file = 0;
+    for(int i = 0; i < command->num_redirects; i++) {
+        reads_file |= (command->redirects[i].type == TOKEN_IN);
+    }
+
+    if(pipeline->num_stages > 1 || (command->argc > 0 && builtin == NULL && !is_shell_command(command->argv[0])) ||
+       (builtin != NULL && (run_in_background || reads_file))) {
+        /*  programs, and the builtins which need a child, read more in exec_pipeline
+        */
+        int status = exec_pipeline(pipeline->stages, pipeline->num_stages);
+        return status == -1 ? 1 : status;
+    }
+    if(builtin != NULL) {
+        /*  the body of the command is linked into the shell, so it runs without a new process
+        */
+        return exec_builtin(builtin, command);
+    }
+
+    int saved[3], status = 0;
+    if(redirect_shell(command, saved) == -1) {
+        return 1;
+    }
+    if(command->argc == 0) {        // only redirections, the files are created and nothing runs
+    } else if(strcmp(command->argv[0], "exit") == 0) {  // handle exit by the shell
+        char *end = "";
+        if(command->argc == 1) {
+            exit_shell(last_status);
+        } else if(command->argc == 2 && (status = strtol(command->argv[1], &end, 10), *end == '\0')) {
+            exit_shell(status & 0xff);
+        } else {
+            fprintf(stderr, (command->argc > 2) ? "exit: too many arguments\n" : "exit: numeric argument required\n");
+            status = (command->argc > 2) ? 1 : 2;
+        }
+    } else {     // handle cd by the shell
+        if(command->argc == 1) {
+            status = cd(home_path);
+        } else if(command->argc == 2) {
+            status = cd(command->argv[1]);
+        } else {
+            fprintf(stderr, "cd: too many arguments\n");
+            status = -1;
+        }
+        status = (status == -1) ? 1 : 0;
+    }
+    restore_shell(saved);
+    return status;
+}
+
+/*  run_line - runs the pipelines of the line one after the other, the one after && only if the
+*   one before succeeded, and the one after || only if it failed
+*   returns the exit status of the last one which ran, or -1 if the line has a syntax error
+*/
+int run_line(char *line, struct arena *arena) {
+
+    struct command_list list;
+    if(parse_line(line, arena, &list) == -1) {
+        return -1;
+    }
+    for(int i = 0; i < list.num_pipelines && !command_interrupted; i++) {     // Ctrl-C stops the whole line
+        struct pipeline *pipeline = &list.pipelines[i];
+        if((pipeline->connector == TOKEN_AND && last_status != 0) || (pipeline->connector == TOKEN_OR && last_status == 0)) {
+            continue;       // skipped, the status stays for the next && or ||
+        }
+        last_status = run_pipeline(pipeline);
+    }
+    return last_status;
+}
+
 /*  run_shell - main loop which prints the prompt and accepts the user input
 *   This is the master loop which spawns new processes to execute the commands
+*   a script runs the same way without the prompt, and stops at a syntax error like sh
+*   returns the status to exit with, the one of the last command at the end of the input
 */
-int run_shell() {
+int run_shell(struct reader *reader, int interactive) {
 
+    struct arena line_arena = ARENA_INIT(LINE_ARENA_SIZE);
+    shell_input = reader;
     while(1) {
 
-        char line[MAX_COMMAND_LENGTH];
-        char *command_argv[MAX_ARGC + 1];
-        int command_argc;
-
-        print_prompt(prompt);       // show user the shell prompt
-        take_line_input(line);      // take the input
-        
-        run_in_background = 0;
-        
-        if(strcmp(line, "") == 0) {     // If '\n' is entered
-            continue;
+        jobs_reap();
+        jobs_notify();              // the jobs in background which are done since the last prompt
+        if(jobs_interrupted()) {
+            printf("\n");          // after the ^C, the prompt starts on a new line
         }
-
-        parse_command(line, command_argv, &command_argc);
-        
-        // After parsing the command, command_argv and command_argc are set so that new process can start
-        if(strcmp(command_argv[0], "exit") == 0) {  // handle exit by the shell  
-            if(command_argc == 1) {
-                exit_shell();
-            }else {
-                fprintf(stderr, "exit: too many arguments\n");
+        if(interactive) {
+            print_prompt(prompt);       // show user the shell prompt
+        }
+        fflush(stdout);
+        char *line = read_line(reader);     // take the input
+        if(line == NULL) {
+            if(interactive) {
+                printf("\n");      // Ctrl-D, the prompt line is ended before leaving
             }
-        } else if(strcmp(command_argv[0], "cd") == 0) {     // handle cd by the shell
-            if(command_argc == 1) {
-                cd(home_path);
-            } else if(command_argc == 2) {
-                cd(command_argv[1]);
-            } else {
-                fprintf(stderr, "cd: too many arguments\n");
+            return last_status;
+        }
+        arena_reset(&line_arena);   // the words of the previous line are not needed anymore
+        if(run_line(line, &line_arena) == -1) {
+            last_status = 2;
+            if(!interactive) {
+                return last_status;
             }
-
-        } else if (check_self_implemented(command_argv[0])) {       // if the command is implemented by us
-            /*  new_binary_path has the path of binary implemented by us
-            *   which is in shell_path/bin/
-            */
-            char *new_binary_path = make_path(shell_path, make_path("bin", strdup(command_argv[0])));
-            command_argv[0] = strdup(new_binary_path);
-            exec_command(command_argv, command_argc);
-
-        } else {
-            /*  try to execute the command normally if it is installed on the system  
-            */
-            exec_command(command_argv, command_argc);
         }
-        
     }
-    return 0;
 }
 
+/*  main - runs the shell on the terminal, or the script given as a file, with -c as a string
+*   or on stdin when it is not a terminal
+*   Usage: ./shell [SCRIPT | -c COMMANDS]
+*/
 int main(int argc, char *argv[]) {
-    initialize_shell();
-    run_shell();
-    exit(EXIT_SUCCESS);
-}
\ No newline at end of file
+    struct reader reader;
+    int interactive = 0, result;
+    if(argc > 1 && strcmp(argv[1], "-c") == 0) {
+        if(argc == 2) {
+            fprintf(stderr, "neosh: -c: option requires an argument\n");
+            exit(2);
+        }
+        result = reader_string(&reader, argv[2]);
+    } else if(argc > 1) {
+        int fd = open(argv[1], O_RDONLY | O_CLOEXEC);
+        if(fd == -1) {
+            fprintf(stderr, "neosh: %s: %s\n", argv[1], strerror(errno));
+            exit(127);
+        }
+        result = reader_init(&reader, fd);
+    } else {
+        interactive = isatty(STDIN_FILENO);
+        result = reader_init(&reader, STDIN_FILENO);
+    }
+    if(result == -1) {
+        fprintf(stderr, "neosh: %s\n", strerror(ENOMEM));
+        exit(EXIT_FAILURE);
+    }
+    initialize_shell(interactive);
+    exit(run_shell(&reader, interactive));
+}
@@ -0,0 +1,221 @@
+/*  Author: Dishank Goel
+*   Date written: 21st August 2020
+*
+*   Output buffer of the commands, read more in outbuf.h
+*/
+
+#define _GNU_SOURCE     // Declared for vasprintf
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include "util.h"
+#include "outbuf.h"
+
+#define MEMORY_START_SIZE 4096
+
+/*  outbuf_init - an empty buffer for the fd, or in memory for OUTBUF_MEMORY
+*   whatever stdio still holds for stdout is flushed first, so that it comes before
+*   returns -1 if there is no memory for the buffer
+*/
+int outbuf_init(struct outbuf *out, int fd) {
+    out->fd = fd;
+    out->tty = (fd != OUTBUF_MEMORY) && isatty(fd);
+    out->error = 0;
+    out->data = NULL;
+    out->used = 0;
+    out->size = 0;
+    if(fd == OUTBUF_MEMORY) {       // it grows with the first write
+        return 0;
+    }
+    if(fd == fileno(stdout)) {
+        fflush(stdout);
+    }
+    out->data = malloc(OUTBUF_SIZE);
+    if(out->data == NULL) {
+        return -1;
+    }
+    out->size = OUTBUF_SIZE;
+    return 0;
+}
+
+/*  write_all - writes all the data to the fd, write may write less than asked
+*/
+static int write_all(struct outbuf *out, const char *data, size_t length) {
+    while(length > 0) {
+        ssize_t n = write(out->fd, data, length);
+        if(n == -1) {
+            if(errno == EINTR) {
+                continue;
+            }
+            if(out->error == 0) {
+                out->error = errno;
+            }
+            return -1;
+        }
+        data += n;
+        length -= n;
+    }
+    return 0;
+}
+
+/*  grow - makes space for length more bytes in a buffer in memory
+*/
+static int grow(struct outbuf *out, size_t length) {
+    size_t size = out->size ? out->size : MEMORY_START_SIZE;
+    while(size - out->used < length) {
+        size *= 2;
+    }
+    char *data = realloc(out->data, size);
+    if(data == NULL) {
+        out->error = ENOMEM;
+        return -1;
+    }
+    out->data = data;
+    out->size = size;
+    return 0;
+}
+
+/*  outbuf_flush - writes everything in the buffer to the fd, nothing to do for a buffer in memory
+*   returns -1 if this or any write before failed
+*/
+int outbuf_flush(struct outbuf *out) {
+    if(out->fd != OUTBUF_MEMORY && out->used > 0) {
+        write_all(out, out->data, out->used);
+        out->used = 0;
+    }
+    return out->error ? -1 : 0;
+}
+
+int outbuf_write(struct outbuf *out, const char *data, size_t length) {
+    if(length > out->size - out->used) {
+        if(out->fd == OUTBUF_MEMORY) {
+            if(grow(out, length) == -1) {
+                return -1;
+            }
+        } else if(outbuf_flush(out) == -1) {
+            return -1;
+        } else if(length >= out->size) {     // too big to be worth copying into the buffer
+            return write_all(out, data, length);
+        }
+    }
+    memcpy(out->data + out->used, data, length);
+    out->used += length;
+    return 0;
+}
+
+int outbuf_puts(struct outbuf *out, const char *string) {
+    return outbuf_write(out, string, strlen(string));
+}
+
+int outbuf_putc(struct outbuf *out, char c) {
+    if(out->used < out->size) {
+        out->data[out->used++] = c;
+        return 0;
+    }
+    return outbuf_write(out, &c, 1);
+}
+
+/*  outbuf_repeat - count times the character c, like spaces to fill a column
+*/
+int outbuf_repeat(struct outbuf *out, char c, size_t count) {
+    while(count > 0) {
+        size_t available;
+        char *space = outbuf_space(out, &available);
+        if(space == NULL) {
+            return -1;
+        }
+        size_t n = (count < available) ? count : available;
+        memset(space, c, n);
+        outbuf_commit(out, n);
+        count -= n;
+    }
+    return 0;
+}
+
+/*  outbuf_color - the string in the given color, or plain when the output is not a terminal
+*   a buffer in memory has the tty of the output it will be printed on
+*/
+int outbuf_color(struct outbuf *out, const char *string, size_t length, const char *color) {
+    if(!out->tty) {
+        return outbuf_write(out, string, length);
+    }
+    outbuf_puts(out, color);
+    outbuf_write(out, string, length);
+    return outbuf_puts(out, RESET);
+}
+
+/*  outbuf_printf - printf into the buffer, formatted right in its free space
+*/
+int outbuf_printf(struct outbuf *out, const char *format, ...) {
+    va_list args;
+    size_t available = out->size - out->used;
+    va_start(args, format);
+    int length = vsnprintf(available ? out->data + out->used : NULL, available, format, args);
+    va_end(args);
+    if(length < 0) {
+        return -1;
+    }
+    if((size_t)length < available) {
+        out->used += length;
+        return 0;
+    }
+
+    if(out->fd == OUTBUF_MEMORY) {
+        if(grow(out, length + 1) == -1) {
+            return -1;
+        }
+    } else if(outbuf_flush(out) == -1) {
+        return -1;
+    }
+    if((size_t)length < out->size - out->used) {        // it fits now, format it again
+        va_start(args, format);
+        vsnprintf(out->data + out->used, out->size - out->used, format, args);
+        va_end(args);
+        out->used += length;
+        return 0;
+    }
+    char *text;         // longer than the whole buffer
+    va_start(args, format);
+    length = vasprintf(&text, format, args);
+    va_end(args);
+    if(length < 0) {
+        out->error = ENOMEM;
+        return -1;
+    }
+    int result = outbuf_write(out, text, length);
+    free(text);
+    return result;
+}
+
+/*  outbuf_space - the free space of the buffer, to read into it directly
+*   the buffer is flushed (or grows in memory) if it is full, the bytes put there
+*   are added with outbuf_commit. Returns NULL if there is no space
+*/
+char *outbuf_space(struct outbuf *out, size_t *available) {
+    if(out->used == out->size) {
+        if(out->fd == OUTBUF_MEMORY) {
+            if(grow(out, 1) == -1) {
+                return NULL;
+            }
+        } else if(outbuf_flush(out) == -1 || out->size == 0) {
+            return NULL;
+        }
+    }
+    *available = out->size - out->used;
+    return out->data + out->used;
+}
+
+void outbuf_commit(struct outbuf *out, size_t length) {
+    out->used += length;
+}
+
+/*  outbuf_free - frees the buffer without writing it, flush it first to keep the output
+*/
+void outbuf_free(struct outbuf *out) {
+    free(out->data);
+    out->data = NULL;
+    out->used = out->size = 0;
+}
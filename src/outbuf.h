@@ -0,0 +1,39 @@
+/*  Author: Dishank Goel
+*   Date written: 21st August 2020
+*
+*   An output buffer for the commands, written with write(2) in big blocks instead of going
+*   through stdio for every small piece of a line
+*   Colors are written only when the output is a terminal, piped output is plain text
+*   A buffer without an fd (OUTBUF_MEMORY) grows in memory, for output that is printed later
+*/
+
+#ifndef NEOSH_OUTBUF_H
+#define NEOSH_OUTBUF_H
+
+#include <stddef.h>
+
+#define OUTBUF_SIZE (1 << 17)
+#define OUTBUF_MEMORY -1
+
+struct outbuf {
+    int fd;             // OUTBUF_MEMORY for a buffer in memory
+    int tty;            // the fd is a terminal, so colors are written
+    int error;          // errno of the first write that failed
+    char *data;
+    size_t used;
+    size_t size;
+};
+
+int outbuf_init(struct outbuf *out, int fd);
+int outbuf_write(struct outbuf *out, const char *data, size_t length);
+int outbuf_puts(struct outbuf *out, const char *string);
+int outbuf_putc(struct outbuf *out, char c);
+int outbuf_repeat(struct outbuf *out, char c, size_t count);
+int outbuf_color(struct outbuf *out, const char *string, size_t length, const char *color);
+int outbuf_printf(struct outbuf *out, const char *format, ...) __attribute__((format(printf, 2, 3)));
+char *outbuf_space(struct outbuf *out, size_t *available);
+void outbuf_commit(struct outbuf *out, size_t length);
+int outbuf_flush(struct outbuf *out);
+void outbuf_free(struct outbuf *out);
+
+#endif
@@ -0,0 +1,271 @@
+/*  Author: Dishank Goel
+*   Date written: 21st August 2020
+*
+*   Parsing of the command lines of the shell, read more in parse.h
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include "parse.h"
+
+#define TOKENS_START 16
+
+/*  operators - longest first, so that || is not read as two |
+*   2> is not here, it is an operator only at the start of a word
+*/
+static const struct operator {
+    const char *text;
+    enum token_type type;
+} operators[] = {
+    {"||", TOKEN_OR}, {"&&", TOKEN_AND}, {"&>", TOKEN_OUT_ERR}, {">>", TOKEN_APPEND},
+    {"|", TOKEN_PIPE}, {"&", TOKEN_BACKGROUND}, {";", TOKEN_SEMICOLON}, {"<", TOKEN_IN}, {">", TOKEN_OUT}
+};
+#define NUM_OPERATORS (sizeof(operators) / sizeof(struct operator))
+
+static const struct operator err_operator = {"2>", TOKEN_ERR};
+
+/*  token_list - the tokens of a line, in an array of the arena which is moved when it is full
+*   the old arrays stay in the arena until it is reset, at most as much as the last one
+*/
+struct token_list {
+    struct arena *arena;
+    struct token *tokens;
+    int num;
+    int capacity;
+};
+
+static int push_token(struct token_list *list, enum token_type type, char *text) {
+    if(list->num == list->capacity) {
+        int capacity = list->capacity ? list->capacity * 2 : TOKENS_START;
+        struct token *tokens = arena_alloc(list->arena, capacity * sizeof(struct token), _Alignof(struct token));
+        if(tokens == NULL) {
+            return -1;
+        }
+        if(list->num > 0) {
+            memcpy(tokens, list->tokens, list->num * sizeof(struct token));
+        }
+        list->tokens = tokens;
+        list->capacity = capacity;
+    }
+    list->tokens[list->num].type = type;
+    list->tokens[list->num].text = text;
+    list->num++;
+    return 0;
+}
+
+static const struct operator *match_operator(char *c) {
+    for(int i = 0; i < NUM_OPERATORS; i++) {
+        size_t length = strlen(operators[i].text);
+        if(strncmp(c, operators[i].text, length) == 0) {
+            return &operators[i];
+        }
+    }
+    return NULL;
+}
+
+/*  tokenize - splits the line into words and operators in a single pass
+*   the words are written one after the other into a single block of the arena as long as the line,
+*   a word without its quotes and escapes is never longer than the part of the line it came from
+*   returns -1 after printing the error if a quote is not closed or there is no memory
+*/
+int tokenize(char *line, struct arena *arena, struct token **tokens, int *num_tokens) {
+
+    struct token_list list = {arena, NULL, 0, 0};
+    char *end = arena_alloc(arena, strlen(line) + 1, 1);        // where the next character of a word goes
+    char *word = NULL;          // start of the word being read, NULL between words
+    if(end == NULL) {
+        fprintf(stderr, "neosh: %s\n", strerror(ENOMEM));
+        return -1;
+    }
+
+    for(char *c = line; ; ) {
+        const struct operator *op = NULL;
+        int separator = (*c == ' ' || *c == '\t' || *c == '\r' || *c == '\n' || *c == '\0');
+        if(!separator && word == NULL && c[0] == '2' && c[1] == '>') {
+            op = &err_operator;
+        } else if(!separator) {
+            op = match_operator(c);
+        }
+
+        if(separator || op != NULL || (word == NULL && *c == '#')) {
+            if(word != NULL) {      // the word ends here
+                *end++ = '\0';
+                if(push_token(&list, TOKEN_WORD, word) == -1) {
+                    break;
+                }
+                word = NULL;
+            }
+            if(*c == '\0' || *c == '#') {       // a comment goes until the end of the line
+                *tokens = list.tokens;
+                *num_tokens = list.num;
+                return 0;
+            } else if(op != NULL) {
+                if(push_token(&list, op->type, (char *)op->text) == -1) {
+                    break;
+                }
+                c += strlen(op->text);
+            } else {
+                c++;
+            }
+            continue;
+        }
+
+        if(word == NULL) {
+            word = end;
+        }
+        if(*c == '\'') {
+            char *close = strchr(c + 1, '\'');
+            if(close == NULL) {
+                fprintf(stderr, "neosh: unexpected end of line while looking for matching '''\n");
+                return -1;
+            }
+            memcpy(end, c + 1, close - c - 1);
+            end += close - c - 1;
+            c = close + 1;
+        } else if(*c == '"') {
+            for(c++; *c != '"'; c++) {
+                if(*c == '\0') {
+                    fprintf(stderr, "neosh: unexpected end of line while looking for matching '\"'\n");
+                    return -1;
+                }
+                if(*c == '\\' && (c[1] == '"' || c[1] == '\\')) {
+                    c++;
+                }
+                *end++ = *c;
+            }
+            c++;
+        } else if(*c == '\\') {
+            if(c[1] != '\0') {      // a \ at the end of the line is dropped
+                *end++ = c[1];
+                c++;
+            }
+            c++;
+        } else {
+            *end++ = *c++;
+        }
+    }
+    fprintf(stderr, "neosh: %s\n", strerror(ENOMEM));
+    return -1;
+}
+
+static int syntax_error(char *text) {
+    fprintf(stderr, "neosh: syntax error near unexpected token '%s'\n", text);
+    return -1;
+}
+
+static int is_redirect(enum token_type type) {
+    return type == TOKEN_IN || type == TOKEN_OUT || type == TOKEN_APPEND || type == TOKEN_ERR || type == TOKEN_OUT_ERR;
+}
+
+/*  parse_pipeline - splits the tokens into the commands connected by '|'
+*   every redirection is followed by the word naming its file
+*   the argv and the redirections of all the commands are slices of two arrays
+*   returns -1 after printing the error if the tokens are not a pipeline, like "ls |"
+*/
+static int parse_pipeline(struct token *tokens, int num_tokens, struct arena *arena, struct pipeline *pipeline) {
+
+    int num_stages = 1, num_redirects = 0;
+    for(int i = 0; i < num_tokens; i++) {
+        if(tokens[i].type == TOKEN_PIPE) {
+            num_stages++;
+        } else if(is_redirect(tokens[i].type)) {
+            if(i + 1 == num_tokens || tokens[i + 1].type != TOKEN_WORD) {
+                return syntax_error(i + 1 == num_tokens ? "newline" : tokens[i + 1].text);
+            }
+            num_redirects++;
+            i++;
+        } else if(tokens[i].type != TOKEN_WORD) {
+            return syntax_error(tokens[i].text);
+        }
+    }
+
+    // the words and a NULL for every stage
+    char **argv = arena_alloc(arena, (num_tokens + 1) * sizeof(char *), _Alignof(char *));
+    struct command *stages = arena_alloc(arena, num_stages * sizeof(struct command), _Alignof(struct command));
+    struct redirect *redirects = arena_alloc(arena, num_redirects * sizeof(struct redirect) + 1, _Alignof(struct redirect));
+    if(argv == NULL || stages == NULL || redirects == NULL) {
+        fprintf(stderr, "neosh: %s\n", strerror(ENOMEM));
+        return -1;
+    }
+    struct command *stage = stages;
+    *stage = (struct command){argv, 0, redirects, 0};
+    for(int i = 0; i < num_tokens; i++) {
+        if(tokens[i].type == TOKEN_PIPE) {
+            // every '|' has to be between two commands
+            if(stage->argc == 0) {
+                return syntax_error("|");
+            }
+            *argv++ = NULL;
+            stage++;
+            *stage = (struct command){argv, 0, redirects, 0};
+        } else if(is_redirect(tokens[i].type)) {
+            redirects->type = tokens[i].type;
+            redirects->path = tokens[i + 1].text;
+            redirects++;
+            stage->num_redirects++;
+            i++;
+        } else {
+            *argv++ = tokens[i].text;
+            stage->argc++;
+        }
+    }
+    *argv = NULL;
+    if(stage->argc == 0 && (num_stages > 1 || stage->num_redirects == 0)) {
+        return syntax_error("|");
+    }
+    pipeline->stages = stages;
+    pipeline->num_stages = num_stages;
+    return 0;
+}
+
+static int is_separator(enum token_type type) {
+    return type == TOKEN_SEMICOLON || type == TOKEN_BACKGROUND || type == TOKEN_AND || type == TOKEN_OR;
+}
+
+/*  parse_line - splits the line into pipelines at ;, &, && and ||
+*   a pipeline ending with & runs in background, && and || tie the next one to its exit status
+*   ; and & may end the line, && and || need a pipeline after them
+*   returns -1 after printing the error if the line is not a list of pipelines, like "; ls"
+*/
+int parse_line(char *line, struct arena *arena, struct command_list *list) {
+
+    struct token *tokens;
+    int num_tokens, num_separators = 0;
+    list->pipelines = NULL;
+    list->num_pipelines = 0;
+    if(tokenize(line, arena, &tokens, &num_tokens) == -1) {
+        return -1;
+    }
+    for(int i = 0; i < num_tokens; i++) {
+        num_separators += is_separator(tokens[i].type);
+    }
+    list->pipelines = arena_alloc(arena, (num_separators + 1) * sizeof(struct pipeline), _Alignof(struct pipeline));
+    if(list->pipelines == NULL) {
+        fprintf(stderr, "neosh: %s\n", strerror(ENOMEM));
+        return -1;
+    }
+
+    enum token_type connector = TOKEN_SEMICOLON;
+    for(int start = 0, i = 0; i <= num_tokens; i++) {
+        if(i < num_tokens && !is_separator(tokens[i].type)) {
+            continue;
+        }
+        if(i == start) {        // nothing before the separator, or after the last one
+            if(i == num_tokens && connector == TOKEN_SEMICOLON) {
+                break;
+            }
+            return syntax_error(i == num_tokens ? "newline" : tokens[i].text);
+        }
+        struct pipeline *pipeline = &list->pipelines[list->num_pipelines++];
+        if(parse_pipeline(tokens + start, i - start, arena, pipeline) == -1) {
+            return -1;
+        }
+        pipeline->connector = connector;
+        pipeline->background = (i < num_tokens && tokens[i].type == TOKEN_BACKGROUND);
+        connector = (i < num_tokens && (tokens[i].type == TOKEN_AND || tokens[i].type == TOKEN_OR)) ? tokens[i].type : TOKEN_SEMICOLON;
+        start = i + 1;
+    }
+    return 0;
+}
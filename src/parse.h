@@ -0,0 +1,75 @@
+/*  Author: Dishank Goel
+*   Date written: 21st August 2020
+*
+*   Parsing of the command lines of the shell
+*   A line is split into tokens in a single pass: words, with their quotes and escapes removed,
+*   and the operators between them. Everything is allocated from an arena which the shell
+*   resets for every line, so parsing does not grow the heap and there is no limit on the
+*   number of arguments
+*
+*   Quoting works like in sh: '...' keeps everything as it is, "..." keeps everything except
+*   that \ escapes " and \, and outside quotes \ escapes any character. # starts a comment
+*/
+
+#ifndef NEOSH_PARSE_H
+#define NEOSH_PARSE_H
+
+#include "arena.h"
+
+enum token_type {
+    TOKEN_WORD,
+    TOKEN_PIPE,             // |
+    TOKEN_OR,               // ||
+    TOKEN_BACKGROUND,       // &
+    TOKEN_AND,              // &&
+    TOKEN_SEMICOLON,        // ;
+    TOKEN_IN,               // <
+    TOKEN_OUT,              // >
+    TOKEN_APPEND,           // >>
+    TOKEN_ERR,              // 2>
+    TOKEN_OUT_ERR           // &>
+};
+
+struct token {
+    enum token_type type;
+    char *text;             // the word, or the operator as written
+};
+
+/*  redirect - a file given to a command with <, >, >>, 2> or &>
+*/
+struct redirect {
+    enum token_type type;
+    char *path;
+};
+
+/*  command - one stage of a pipeline, with the argv and argc for its process
+*   argv is ended by NULL, like exec wants it. A command of only redirections has no argv[0]
+*/
+struct command {
+    char **argv;
+    int argc;
+    struct redirect *redirects;     // in the order they were written, the last one for an fd wins
+    int num_redirects;
+};
+
+/*  pipeline - commands connected by pipes
+*/
+struct pipeline {
+    struct command *stages;
+    int num_stages;
+    int background;                 // it ended with &
+    enum token_type connector;      // how it follows the one before: TOKEN_SEMICOLON, TOKEN_AND or TOKEN_OR
+};
+
+/*  command_list - the pipelines of a line, separated by ;, &, && and ||
+*   an empty line, or only a comment, has none
+*/
+struct command_list {
+    struct pipeline *pipelines;
+    int num_pipelines;
+};
+
+int tokenize(char *line, struct arena *arena, struct token **tokens, int *num_tokens);
+int parse_line(char *line, struct arena *arena, struct command_list *list);
+
+#endif
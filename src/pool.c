@@ -0,0 +1,248 @@
+/*  Author: Dishank Goel
+*   Date written: 21st August 2020
+*
+*   A pool of worker threads with work stealing, read more in pool.h
+*/
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "pool.h"
+
+struct task {
+    task_fn fn;
+    void *arg;
+};
+
+/*  deque - the queue of one worker, a growable ring buffer
+*   the owner pushes and pops at the tail, thieves take from the head
+*/
+struct deque {
+    pthread_mutex_t lock;
+    struct task *tasks;
+    size_t head, count, capacity;
+};
+
+struct worker {
+    struct pool *pool;
+    int id;
+    pthread_t thread;
+};
+
+struct pool {
+    int num_workers;
+    struct worker *workers;
+    struct deque *deques;
+
+    pthread_mutex_t lock;       // protects the counters below
+    pthread_cond_t work;        // signalled when a task is queued or the pool shuts down
+    pthread_cond_t done;        // signalled when there are no pending tasks
+    size_t queued;              // tasks sitting in the deques
+    size_t pending;             // tasks submitted and not finished yet
+    size_t next_deque;          // round robin for tasks submitted from outside the pool
+    int shutdown;
+};
+
+static __thread struct worker *current_worker;       // the worker running on this thread, if any
+
+static int deque_push(struct deque *d, struct task t) {
+    pthread_mutex_lock(&d->lock);
+    if(d->count == d->capacity) {
+        size_t capacity = d->capacity ? 2 * d->capacity : 64;
+        struct task *tasks = malloc(capacity * sizeof(struct task));
+        if(tasks == NULL) {
+            pthread_mutex_unlock(&d->lock);
+            return -1;
+        }
+        for(size_t i = 0; i < d->count; i++) {      // unwrap the ring into the new buffer
+            tasks[i] = d->tasks[(d->head + i) % d->capacity];
+        }
+        free(d->tasks);
+        d->tasks = tasks;
+        d->head = 0;
+        d->capacity = capacity;
+    }
+    d->tasks[(d->head + d->count) % d->capacity] = t;
+    d->count++;
+    pthread_mutex_unlock(&d->lock);
+    return 0;
+}
+
+/*  deque_take - takes the newest task (owner) or the oldest task (thief)
+*/
+static int deque_take(struct deque *d, struct task *t, int steal) {
+    int found = 0;
+    pthread_mutex_lock(&d->lock);
+    if(d->count > 0) {
+        if(steal) {
+            *t = d->tasks[d->head];
+            d->head = (d->head + 1) % d->capacity;
+        } else {
+            *t = d->tasks[(d->head + d->count - 1) % d->capacity];
+        }
+        d->count--;
+        found = 1;
+    }
+    pthread_mutex_unlock(&d->lock);
+    return found;
+}
+
+/*  find_task - first looks into the own deque, then tries to steal from the others
+*/
+static int find_task(struct pool *pool, int id, struct task *t) {
+    if(deque_take(&pool->deques[id], t, 0)) {
+        return 1;
+    }
+    for(int i = 1; i < pool->num_workers; i++) {
+        if(deque_take(&pool->deques[(id + i) % pool->num_workers], t, 1)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void *worker_loop(void *arg) {
+    struct worker *self = arg;
+    struct pool *pool = self->pool;
+    current_worker = self;
+
+    while(1) {
+        struct task t;
+        if(find_task(pool, self->id, &t)) {
+            pthread_mutex_lock(&pool->lock);
+            pool->queued--;
+            pthread_mutex_unlock(&pool->lock);
+
+            t.fn(t.arg);
+
+            pthread_mutex_lock(&pool->lock);
+            if(--pool->pending == 0) {
+                pthread_cond_broadcast(&pool->done);
+            }
+            pthread_mutex_unlock(&pool->lock);
+            continue;
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        while(pool->queued == 0 && !pool->shutdown) {
+            pthread_cond_wait(&pool->work, &pool->lock);
+        }
+        int stop = pool->shutdown && pool->queued == 0;
+        pthread_mutex_unlock(&pool->lock);
+        if(stop) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+/*  pool_default_workers - one worker for every online cpu
+*/
+int pool_default_workers() {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? n : 1;
+}
+
+/*  pool_create - starts the workers, returns NULL if the pool could not be created
+*/
+struct pool *pool_create(int num_workers) {
+    if(num_workers < 1) {
+        num_workers = 1;
+    }
+    struct pool *pool = calloc(1, sizeof(struct pool));
+    if(pool == NULL) {
+        return NULL;
+    }
+    pool->num_workers = num_workers;
+    pool->workers = calloc(num_workers, sizeof(struct worker));
+    pool->deques = calloc(num_workers, sizeof(struct deque));
+    if(pool->workers == NULL || pool->deques == NULL) {
+        free(pool->workers);
+        free(pool->deques);
+        free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    for(int i = 0; i < num_workers; i++) {
+        pthread_mutex_init(&pool->deques[i].lock, NULL);
+    }
+    for(int i = 0; i < num_workers; i++) {
+        pool->workers[i].pool = pool;
+        pool->workers[i].id = i;
+        if(pthread_create(&pool->workers[i].thread, NULL, worker_loop, &pool->workers[i]) != 0) {
+            pool->num_workers = i;          // run with the workers we could start
+            break;
+        }
+    }
+    if(pool->num_workers == 0) {
+        pool_destroy(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+/*  pool_submit - queues fn(arg) to be run by a worker
+*   tasks can submit more tasks, those go to the deque of the worker running them
+*/
+int pool_submit(struct pool *pool, task_fn fn, void *arg) {
+    struct task t = {fn, arg};
+    int id;
+    if(current_worker != NULL && current_worker->pool == pool) {
+        id = current_worker->id;
+    } else {
+        pthread_mutex_lock(&pool->lock);
+        id = pool->next_deque++ % pool->num_workers;
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    /*  the task is pushed and counted under the lock, a worker which steals it right after the push
+    *   waits for the lock before it counts it as taken, and an idle worker is only woken once
+    *   the task is in a deque, so it never spins on empty deques
+    */
+    pthread_mutex_lock(&pool->lock);
+    if(deque_push(&pool->deques[id], t) == -1) {
+        pthread_mutex_unlock(&pool->lock);
+        return -1;
+    }
+    pool->queued++;
+    pool->pending++;
+    pthread_cond_signal(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+    return 0;
+}
+
+/*  pool_wait - waits until every submitted task, and every task they submitted, is finished
+*/
+void pool_wait(struct pool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    while(pool->pending > 0) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/*  pool_destroy - finishes the queued tasks, stops the workers and frees the pool
+*/
+void pool_destroy(struct pool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+
+    for(int i = 0; i < pool->num_workers; i++) {
+        pthread_join(pool->workers[i].thread, NULL);
+    }
+    for(int i = 0; i < pool->num_workers; i++) {
+        free(pool->deques[i].tasks);
+        pthread_mutex_destroy(&pool->deques[i].lock);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work);
+    pthread_cond_destroy(&pool->done);
+    free(pool->workers);
+    free(pool->deques);
+    free(pool);
+}
@@ -0,0 +1,23 @@
+/*  Author: Dishank Goel
+*   Date written: 21st August 2020
+*
+*   A pool of worker threads with work stealing, used by the commands to spread work across cores
+*   Every worker has its own queue of tasks. A task submitted from inside a worker goes to the
+*   queue of that worker, and is taken back in LIFO order (depth first when walking trees).
+*   A worker with an empty queue steals the oldest task from the queues of other workers
+*/
+
+#ifndef NEOSH_POOL_H
+#define NEOSH_POOL_H
+
+typedef void (*task_fn)(void *arg);
+
+struct pool;
+
+struct pool *pool_create(int num_workers);
+int pool_submit(struct pool *pool, task_fn fn, void *arg);
+void pool_wait(struct pool *pool);
+void pool_destroy(struct pool *pool);
+int pool_default_workers();
+
+#endif
@@ -11,14 +11,15 @@
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
+#include "builtins.h"
 
 #define MAX_SHELL_PATH 1024
 
-int main(int argc, char *argv[]) {
+int pwd_main(int argc, char *argv[]) {
 
     if(argc > 1) {
         fprintf(stderr, "pwd: too many arguments\n");   // pwd does not work if multiple arguments are given
-        exit(EXIT_FAILURE);
+        return EXIT_FAILURE;
     } else {
         char *buf;
         buf = malloc(MAX_SHELL_PATH * sizeof(char));
@@ -27,8 +28,14 @@ int main(int argc, char *argv[]) {
             free(buf);
         } else {
             fprintf(stderr, "pwd: %s\n", strerror(errno));
-            exit(EXIT_FAILURE);
+            return EXIT_FAILURE;
         }
     }
-    exit(EXIT_SUCCESS);
-}
\ No newline at end of file
+    return EXIT_SUCCESS;
+}
+
+#ifndef NEOSH_BUILTIN
+int main(int argc, char *argv[]) {
+    return pwd_main(argc, argv);
+}
+#endif
@@ -0,0 +1,320 @@
+/*  Author: Dishank Goel
+*   Date written: 21st August 2020
+*
+*   Removing directory trees with a pool of workers, read more in remove.h
+*/
+
+#define _GNU_SOURCE     // Declared for O_DIRECTORY and O_NOFOLLOW
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <errno.h>
+#include <string.h>
+#include "util.h"
+#include "pool.h"
+#include "remove.h"
+
+#define REMOVE_MAX_DEPTH 64     // below this depth a subtree is removed by one task, holding one fd
+
+struct tree_remove {
+    struct pool *pool;
+    char *program;          // prefix of the error messages, like "rm"
+    atomic_int error;
+};
+
+/*  remove_dir - an open directory being emptied, shared by the tasks of its subdirectories
+*   when the last of them is done, the directory is empty and is removed from its parent,
+*   which may then be empty too. The top directory has no parent, its name is its path
+*/
+struct remove_dir {
+    struct tree_remove *tree;
+    struct remove_dir *parent;
+    DIR *stream;
+    char *name;             // relative to the parent
+    char *path;             // for the error messages
+    int depth;
+    atomic_int refs;
+};
+
+/*  remove_task - a subdirectory to be emptied and removed, it holds a reference on its parent
+*/
+struct remove_task {
+    struct tree_remove *tree;
+    struct remove_dir *parent;
+    char *name;
+    char *path;
+};
+
+/*  remove_report - prints the error, nothing is printed once the command is interrupted
+*/
+static void remove_report(struct tree_remove *tree, char *path, int error) {
+    if(!command_interrupted) {
+        fprintf(stderr, "%s: cannot remove '%s': %s\n", tree->program, path, strerror(error));
+    }
+    tree->error = 1;
+}
+
+static int parent_fd(struct remove_dir *parent) {
+    return parent ? dirfd(parent->stream) : AT_FDCWD;
+}
+
+/*  release_remove_dir - drops a reference, the last one removes the directory and then
+*   drops the reference it held on its parent
+*/
+static void release_remove_dir(struct remove_dir *dir) {
+    while(dir != NULL && atomic_fetch_sub(&dir->refs, 1) == 1) {
+        struct remove_dir *parent = dir->parent;
+        closedir(dir->stream);
+        if(unlinkat(parent_fd(parent), dir->name, AT_REMOVEDIR) == -1 &&
+           !(errno == ENOTEMPTY && dir->tree->error)) {      // an entry which could not be removed was reported
+            remove_report(dir->tree, dir->path, errno);
+        }
+        free(dir->name);
+        free(dir->path);
+        free(dir);
+        dir = parent;
+    }
+}
+
+static void remove_dir_task(void *arg);
+
+/*  remove_spawn - hands the task to the pool, or runs it right here if it cannot be queued
+*/
+static void remove_spawn(struct remove_task *t) {
+    if(t->tree->pool == NULL || pool_submit(t->tree->pool, remove_dir_task, t) == -1) {
+        remove_dir_task(t);
+    }
+}
+
+/*  remove_serial - empties the directory fd, below path, on this thread with one fd open at a time
+*   it goes down into the first subdirectory it finds, closing the directory above, and comes back
+*   up with .., so the open fds do not grow with the depth of the tree. Only the names of the
+*   directories it is in are kept, to remove each from its parent on the way up
+*   fd is closed, returns -1 if something was left behind (it is reported), 0 otherwise
+*/
+static int remove_serial(struct tree_remove *tree, int fd, char *path) {
+    char **names = NULL;        // names[i] is the directory at depth i + 1, below path
+    int depth = 0, capacity = 0, result = 0;
+    while(fd != -1) {
+        DIR *stream = fdopendir(fd);
+        if(stream == NULL) {
+            remove_report(tree, path, errno);
+            close(fd);
+            result = -1;
+            break;
+        }
+        fd = dirfd(stream);
+        char *subdir = NULL;
+        int error = 0;
+        struct dirent *entry;
+        while(error == 0 && !command_interrupted && (entry = readdir(stream)) != NULL) {
+            char *name = entry->d_name;
+            if(strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+                continue;
+            }
+            if(entry->d_type != DT_DIR && unlinkat(fd, name, 0) == 0) {
+                continue;
+            } else if(entry->d_type == DT_DIR || (entry->d_type == DT_UNKNOWN && errno == EISDIR)) {
+                if((subdir = strdup(name)) == NULL) {
+                    error = ENOMEM;
+                }
+                break;
+            }
+            error = errno;
+            subdir = strdup(name);
+        }
+        if(error == 0 && command_interrupted) {
+            error = EINTR;
+        }
+
+        if(error == 0 && subdir != NULL) {      // down into it
+            int child = openat(fd, subdir, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+            char **bigger = names;
+            if(child != -1 && depth == capacity) {
+                capacity = capacity ? 2 * capacity : 64;
+                bigger = realloc(names, capacity * sizeof(char *));
+            }
+            if(child != -1 && bigger != NULL) {
+                names = bigger;
+                names[depth++] = subdir;
+                closedir(stream);
+                fd = child;
+                continue;
+            }
+            error = (child == -1) ? errno : ENOMEM;
+            if(child != -1) {
+                close(child);
+            }
+        }
+        if(error != 0) {        // reported with its path, then everything above is left as it is
+            size_t length = strlen(path) + 2 + (subdir ? strlen(subdir) : 0);
+            for(int i = 0; i < depth; i++) {
+                length += strlen(names[i]) + 1;
+            }
+            char *full = malloc(length);
+            if(full != NULL) {
+                strcpy(full, path);
+                for(int i = 0; i < depth; i++) {
+                    strcat(strcat(full, "/"), names[i]);
+                }
+                if(subdir != NULL) {
+                    strcat(strcat(full, "/"), subdir);
+                }
+            }
+            remove_report(tree, full ? full : path, error);
+            free(full);
+            free(subdir);
+            closedir(stream);
+            result = -1;
+            break;
+        }
+
+        /*  the directory is empty, it is removed from its parent, which is read again from the start */
+        if(depth == 0) {
+            closedir(stream);
+            break;
+        }
+        int up = openat(fd, "..", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        closedir(stream);
+        depth--;
+        if(up == -1 || unlinkat(up, names[depth], AT_REMOVEDIR) == -1) {
+            remove_report(tree, path, errno);
+            if(up != -1) {
+                close(up);
+            }
+            free(names[depth]);
+            result = -1;
+            break;
+        }
+        free(names[depth]);
+        fd = up;
+    }
+    for(int i = 0; i < depth; i++) {
+        free(names[i]);
+    }
+    free(names);
+    return result;
+}
+
+/*  remove_dir_task - opens a directory relative to its parent and unlinks every file in it
+*   right away, the subdirectories are spawned as tasks. The type of an entry comes from d_type,
+*   if the file system does not fill it, the entry is unlinked as a file and EISDIR tells it is not
+*   past REMOVE_MAX_DEPTH the whole subtree is removed by remove_serial, so a deep tree does not
+*   keep an fd open for every level
+*/
+static void remove_dir_task(void *arg) {
+    struct remove_task *t = arg;
+    struct tree_remove *tree = t->tree;
+    int depth = t->parent ? t->parent->depth + 1 : 0;
+    int fd = openat(parent_fd(t->parent), t->name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if(fd != -1 && depth >= REMOVE_MAX_DEPTH) {
+        if(remove_serial(tree, fd, t->path) == 0 &&
+           unlinkat(parent_fd(t->parent), t->name, AT_REMOVEDIR) == -1) {
+            remove_report(tree, t->path, errno);
+        }
+        release_remove_dir(t->parent);
+        free(t->name);
+        free(t->path);
+        free(t);
+        return;
+    }
+    DIR *stream = (fd == -1) ? NULL : fdopendir(fd);
+    struct remove_dir *dir = (stream == NULL) ? NULL : malloc(sizeof(struct remove_dir));
+    if(dir == NULL) {
+        remove_report(tree, t->path, stream == NULL ? errno : ENOMEM);
+        if(stream != NULL) {
+            closedir(stream);
+        } else if(fd != -1) {
+            close(fd);
+        }
+        release_remove_dir(t->parent);
+        free(t->name);
+        free(t->path);
+        free(t);
+        return;
+    }
+    dir->tree = tree;
+    dir->parent = t->parent;        // the directory takes over the reference and the names of its task
+    dir->stream = stream;
+    dir->name = t->name;
+    dir->path = t->path;
+    dir->depth = depth;
+    atomic_init(&dir->refs, 1);     // held by this task until all the entries are done
+    free(t);
+
+    struct dirent *entry;
+    while((entry = readdir(stream)) != NULL) {
+        if(command_interrupted) {       // what is left stays, the directories above are not removed
+            tree->error = 1;
+            break;
+        }
+        char *name = entry->d_name;
+        if(strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+            continue;
+        }
+        if(entry->d_type != DT_DIR) {
+            if(unlinkat(fd, name, 0) == 0) {
+                continue;
+            } else if(entry->d_type != DT_UNKNOWN || errno != EISDIR) {
+                char *path = make_path(dir->path, name);
+                remove_report(tree, path ? path : name, errno);
+                free(path);
+                continue;
+            }
+        }
+
+        struct remove_task *child = malloc(sizeof(struct remove_task));
+        char *child_name = strdup(name);
+        char *path = make_path(dir->path, name);
+        if(child == NULL || child_name == NULL || path == NULL) {
+            remove_report(tree, dir->path, ENOMEM);
+            free(child);
+            free(child_name);
+            free(path);
+            break;
+        }
+        child->tree = tree;
+        child->parent = dir;
+        child->name = child_name;
+        child->path = path;
+        atomic_fetch_add(&dir->refs, 1);
+        remove_spawn(child);
+    }
+    release_remove_dir(dir);
+}
+
+/*  remove_tree - removes the directory with everything inside it, symbolic links are removed
+*   and never followed. The subdirectories are emptied by a pool of workers, every directory is
+*   removed by the task which empties its last subdirectory
+*   errors are printed with program as prefix, returns -1 if there was any, 0 otherwise
+*/
+int remove_tree(char *path, char *program) {
+    struct tree_remove tree;
+    tree.program = program;
+    tree.pool = pool_create(pool_default_workers());       // if it is NULL, the removal runs on this thread
+    atomic_init(&tree.error, 0);
+
+    struct remove_task *t = malloc(sizeof(struct remove_task));
+    char *name = strdup(path), *path_copy = strdup(path);
+    if(t == NULL || name == NULL || path_copy == NULL) {
+        free(t);
+        free(name);
+        free(path_copy);
+        remove_report(&tree, path, ENOMEM);
+    } else {
+        t->tree = &tree;
+        t->parent = NULL;
+        t->name = name;
+        t->path = path_copy;
+        remove_spawn(t);
+    }
+
+    if(tree.pool != NULL) {
+        pool_wait(tree.pool);
+        pool_destroy(tree.pool);
+    }
+    return tree.error ? -1 : 0;
+}
@@ -0,0 +1,16 @@
+/*  Author: Dishank Goel
+*   Date written: 21st August 2020
+*
+*   Removing directory trees, used by rm -r and by mv when it has to copy across file systems
+*   Every directory is opened relative to its parent and its entries are removed with unlinkat
+*   relative to it, so no path is resolved again. Subdirectories are removed by a pool of workers
+*   A very deep tree is removed below a fixed depth by one task going down and up with .., so the
+*   open fds stay bounded whatever the depth
+*/
+
+#ifndef NEOSH_REMOVE_H
+#define NEOSH_REMOVE_H
+
+int remove_tree(char *path, char *program);
+
+#endif
@@ -6,8 +6,6 @@
 *   Usage: rm [-r] [FILE]...
 */
 
-
-#define _XOPEN_SOURCE 500       // Declared for nftw, traversing the tree strcuture of a directory 
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -16,51 +14,47 @@
 #include <errno.h>
 #include <sys/stat.h>
 #include <sys/types.h>
-#include <ftw.h>
 #include "util.h"
+#include "remove.h"
+#include "builtins.h"
 
-bool remove_directory = false;      // checks if -r option is supplied
+static bool remove_directory = false;      // checks if -r option is supplied
 
-int print_usage() {
+static int print_usage() {
     fprintf(stderr, "Usage: rm [-r] [FILE]...\n");
-    exit(EXIT_FAILURE);
+    return EXIT_FAILURE;
 }
 
-/*  remove_file - this function is called for each file while traversing the directory tree using nftw
-*   path is path of the file being removed
-*   typeflag is the type of file being processed, check man 3 nftw
+/*  remove_file - removes a file, or a symbolic link without following it
 */
-int remove_file(const char *path, const struct stat *sb, int typeflag, struct FTW *ftwbuf) {
-
-    int n = remove(path);       // can remove files and empty directories
-    if(n) {
+static int remove_file(char *path) {
+    if(unlink(path) == -1) {
         fprintf(stderr, "rm: cannot remove '%s': %s\n", path, strerror(errno));
         return -1;
     }
     return 0;
 }
 
-/* traverse_directory - recursively traverse the directory in depth first fashion
+/*  is_dot_or_dotdot - rm -r . would empty the current directory and then fail to remove it
 */
-int traverse_directory(char *path) {
-    
-    /*  64 is the maximum number of directories that can be opened at once, 
-    *   FTW_DEPTH specifies to traverse post order tree walk, so that files are deleted first,
-    *   and then empty directories
-    */
-    return nftw(path, remove_file, 64, FTW_DEPTH | FTW_PHYS);
+static bool is_dot_or_dotdot(char *path) {
+    char *base = strrchr(path, '/');
+    base = (base == NULL) ? path : base + 1;
+    return strcmp(base, ".") == 0 || strcmp(base, "..") == 0;
 }
 
-int main(int argc, char *argv[])
+int rm_main(int argc, char *argv[])
 {
     /*  for parsing the -r option 
     */
     int opt;
+    remove_directory = false;
+    optind = 0;         // getopt starts over, since the shell calls rm_main many times
     while ((opt = getopt(argc, argv, "r")) != -1) {
         switch (opt) {
         case 'r': remove_directory = true; break;
         default:
-            print_usage();
+            return print_usage();
         }
     }
 
@@ -70,33 +64,41 @@ int main(int argc, char *argv[])
     int any_error = 0;
     int num_nop_argument = argc - optind;   // number of non option arguments
     if(num_nop_argument <= 0) {
-        print_usage();
+        return print_usage();
     } else {
-        for(int i = optind; i < argc; i++) {        // loop over all the non option arguments
-            int n = check_dir(argv[i]);
-            if(n && n != -1) {      // the target file is a directory
-                if(remove_directory) {      // if -r option is specified
-                    traverse_directory(argv[i]);  
-                } else {
+        for(int i = optind; i < argc && !command_interrupted; i++) {        // loop over all the non option arguments
+            struct stat statbuf;
+            if(lstat(argv[i], &statbuf) == -1) {        // the file does not exist, links are not followed
+                fprintf(stderr, "rm: cannot remove '%s': %s\n", argv[i], strerror(errno));
+                any_error = 1;
+            } else if(S_ISDIR(statbuf.st_mode)) {      // the target file is a directory
+                if(!remove_directory) {
                     fprintf(stderr, "rm: -r not specified; omiting directory '%s'\n", argv[i]);
                     any_error = 1;      // We detected an error
+                } else if(is_dot_or_dotdot(argv[i])) {
+                    fprintf(stderr, "rm: refusing to remove '.' or '..' directory: skipping '%s'\n", argv[i]);
+                    any_error = 1;
+                } else if(remove_tree(argv[i], "rm") == -1) {      // read more in remove.h
+                    any_error = 1;      // the errors are printed by remove_tree
                 }
-            } else if (!n && n != -1) {     // the target file is a normal file
-                struct stat buf;
-                struct FTW ftwbuf;
-                if(remove_file(argv[i], &buf, FTW_F, &ftwbuf) == -1) {
-                    any_error = 1;      // there was an error removing the file, error printing will be handled by remove_file
-                }
-            } else {        // the file does not exist
-                fprintf(stderr, "rm: cannot remove '%s': No such file or directory\n", argv[i]);
-                any_error = 1;
+            } else if(remove_file(argv[i]) == -1) {     // the target file is a normal file
+                any_error = 1;      // there was an error removing the file, error printing will be handled by remove_file
             }
         }
+        if(command_interrupted) {
+            return INTERRUPTED_STATUS;
+        }
         if(any_error) {
-            exit(EXIT_FAILURE);
+            return EXIT_FAILURE;
         }
         
     }
-    exit(EXIT_SUCCESS);
+    return EXIT_SUCCESS;
 
-}
\ No newline at end of file
+}
+
+#ifndef NEOSH_BUILTIN
+int main(int argc, char *argv[]) {
+    return rm_main(argc, argv);
+}
+#endif
@@ -0,0 +1,77 @@
+/*  Author: Dishank Goel
+*   Date written: 21st August 2020
+*
+*   Common functions shared by the shell and the self implemented commands
+*   Declarations and the ANSI colors are in util.h
+*/
+
+#include "util.h"
+
+volatile sig_atomic_t command_interrupted;
+
+/*  make_path - It creates a path from source dir and the file
+*   Comes handy in creating paths when files are being copied or moved
+*   returns the new path
+*/
+char *make_path(char *dir, char *file) {
+    char *new_path;
+    new_path = malloc((1 + strlen(file) + strlen(dir) + 1 + 2)*sizeof(char));
+    if(new_path != NULL) {
+        strcpy(new_path, dir);
+        strcat(new_path, "/");
+        strcat(new_path, file);
+    }
+    return new_path;
+}
+
+/*  base_name - the last component of the path, without the slashes after it
+*   dir/file and dir/file/ both give file, returns NULL if there is no memory
+*/
+char *base_name(char *path) {
+    size_t length = strlen(path);
+    while(length > 1 && path[length - 1] == '/') {
+        length--;
+    }
+    size_t start = length;
+    while(start > 0 && path[start - 1] != '/') {
+        start--;
+    }
+    return strndup(path + start, length - start);
+}
+
+/*  check_dir - this function checks the status of a file about:
+*   1. if the file is a directory: return true (Use the condition: n && n != -1)
+*   2. if the file is a normal file: returns false (Use the condition: !n && n != -1)
+*   3. if the file does not exist return -1
+*/
+int check_dir(char *filename) {
+    struct stat statbuf;
+    if(stat(filename, &statbuf) == -1) {
+        return -1;
+    }else {
+        return S_ISDIR(statbuf.st_mode);
+    }
+}
+
+/* check_executable - returns 1 if the file is an executable
+*/
+int check_executable(char *filename) {
+    struct stat statbuf;
+    if((stat(filename, &statbuf) == 0) && statbuf.st_mode & S_IXUSR) {
+        return 1;
+    } else {
+        return 0;
+    }
+}
+
+/*  print_color_string - given a color, prints the given string in that color
+*/
+void print_color_string(char *to_print, char *color) {
+    fprint_color_string(stdout, to_print, color);
+}
+
+/*  fprint_color_string - same as print_color_string, on the given stream
+*/
+void fprint_color_string(FILE *stream, char *to_print, char *color) {
+    fprintf(stream, "%s%s" RESET, color, to_print);
+}
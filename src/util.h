@@ -2,8 +2,12 @@
 *   Date written: 21st August 2020
 *
 *   This is a header supporting other files which common funtions
+*   The functions are defined in util.c, which is linked into every binary and the shell
 */   
 
+#ifndef NEOSH_UTIL_H
+#define NEOSH_UTIL_H
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -12,6 +16,7 @@
 #include <dirent.h>
 #include <errno.h>
 #include <string.h>
+#include <signal.h>
 
 // Declares some common ANSI colors
 
@@ -29,50 +34,18 @@
 #define BOLD_PURPLE "\033[1;35m"
 #define BOLD_CYAN "\033[1;36m"
 
-/*  make_path - It creates a path from source dir and the file
-*   Comes handy in creating paths when files are being copied or moved
-*   returns the new path
+/*  command_interrupted - set by the shell when Ctrl-C is typed while a command runs inside it
+*   the long loops of the commands check it and stop, the command then returns INTERRUPTED_STATUS
+*   like a program killed by SIGINT. In the standalone binaries it is never set
 */
-char *make_path(char *dir, char *file) {
-    char *new_path;
-    new_path = malloc((1 + strlen(file) + strlen(dir) + 1 + 2)*sizeof(char));
-    if(new_path != NULL) {
-        strcpy(new_path, dir);
-        strcat(new_path, "/");
-        strcat(new_path, file);
-    }
-    return new_path;
-}
+extern volatile sig_atomic_t command_interrupted;
+#define INTERRUPTED_STATUS 130
 
-/*  check_dir - this function checks the status of a file about:
-*   1. if the file is a directory: return true (Use the condition: n && n != -1)
-*   2. if the file is a normal file: returns false (Use the condition: !n && n != -1)
-*   3. if the file does not exist return -1
-*/
-int check_dir(char *filename) {
-    struct stat statbuf;
-    if(stat(filename, &statbuf) == -1) {
-        return -1;
-    }else {
-        return S_ISDIR(statbuf.st_mode);
-    }
-}
+char *make_path(char *dir, char *file);
+char *base_name(char *path);
+int check_dir(char *filename);
+int check_executable(char *filename);
+void print_color_string(char *to_print, char *color);
+void fprint_color_string(FILE *stream, char *to_print, char *color);
 
-/* check_executable - returns 1 if the file is an executable
-*/
-int check_executable(char *filename) {
-    struct stat statbuf;
-    if((stat(filename, &statbuf) == 0) && statbuf.st_mode & S_IXUSR) {
-        return 1;
-    } else {
-        return 0;
-    }
-}
-
-/*  print_color_string - given a color, prints the given string in that color
-*/
-void print_color_string(char *to_print, char *color) {
-    printf("%s", color);
-    printf("%s", to_print);
-    printf("%s", RESET);
-}
\ No newline at end of file
+#endif